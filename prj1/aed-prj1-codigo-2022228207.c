@@ -1,10 +1,13 @@
-/* Código feito para C99, compilado com GCC 14.2.1 e flags -O2 e --fast-math
+/* Código feito para C99, compilado com GCC 14.2.1 e flags -O2, --fast-math e -pthread
  * Hardware Original: SATELLITE_C50-A PSCG6P-01YAR1, 
  * CPU: Intel i5-3320M (4) @ 3.300GHz, GPU: GPU: Intel 3rd Gen Core processor Graphics Controller
  * RAM: 7821MiB, SSD SATA3 1TB
  * 
  * Aluno: Vasco Alves, 2022228207
 */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include <stdint.h>
 
 #include <stdio.h>
@@ -13,22 +16,181 @@
 #include <time.h>
 #include <limits.h>
 
+#include <string.h>
+
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RANGE_HAVE_X86 1
+#endif
+
 #define TRUE 1
 #define FALSE 0
 
-#define RAND(a, b) ((a) + rand() % ((b) - (a) + 1))
-
 void print_arr(int* arr, int len);
-int comp(const void *a, const void *b);
-void range_missing_fill(int* seq, size_t len, int beg);
 
 int range_check_missing_naive(int* seq, size_t len);
 int range_check_missing_sort(int* seq, size_t len);
 int range_check_missing_checksum(int* seq, size_t len);
 
+/* Sort engine behind range_check_missing_sort: LSD radix with 11-bit digits,
+ * qsort for tiny inputs, when the scratch buffer can't be allocated or on -s qsort */
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES ((32 + RADIX_BITS - 1) / RADIX_BITS)
+#define RADIX_MIN_LEN 64
+
+enum { RANGE_SORT_RADIX, RANGE_SORT_QSORT };
+int range_sort_kind = RANGE_SORT_RADIX;
+
+void range_radix_sort(int* seq, size_t len, int* tmp);
+void range_sort(int* seq, size_t len);
+int range_sort_gap_scan(const int* seq, size_t len);
+
+/* Already sorted input: sampled sortedness check, then O(log n) searches */
+#define PRESORTED_SAMPLES 64
+
+int range_is_sorted_sampled(const int* seq, size_t len);
+int range_check_missing_presorted(int* seq, size_t len);
+int range_check_missing_gallop(const int* seq, size_t len, size_t* checked);
+
+/* Single pass min/max/sum over the array, used by the checksum finder */
+typedef struct RangeStats {
+  int64_t min;
+  int64_t max;
+  int64_t sum;
+} RangeStats;
+
+typedef void (*range_stats_fn)(const int* seq, size_t len, RangeStats* out);
+
+void range_stats_scalar(const int* seq, size_t len, RangeStats* out);
+#ifdef RANGE_HAVE_X86
+void range_stats_sse41(const int* seq, size_t len, RangeStats* out);
+void range_stats_avx2(const int* seq, size_t len, RangeStats* out);
+void range_stats_avx512(const int* seq, size_t len, RangeStats* out);
+#endif
+const char* range_stats_dispatch(void);
+int range_missing_from_stats(const RangeStats* stats);
+
+/* Selected once at startup by range_stats_dispatch() */
+range_stats_fn range_stats_kernel = range_stats_scalar;
+
+/* Threaded finders: the array is split in one contiguous chunk per thread */
+#define MAX_THREADS 256
+
+typedef struct RangeWorker {
+  int* seq;           /* chunk (or merge destination) */
+  size_t len;
+  RangeStats stats;   /* partial min/max/sum */
+  uint64_t* bitmap;   /* partial presence bitmap over [base, base + 64*words) */
+  int64_t base;
+  size_t words;
+  size_t first_word;  /* word slice scanned after the bitmaps are merged */
+  size_t last_word;
+  struct RangeWorker* all;
+  int nthreads;
+  int missing;        /* first missing value found in this slice, else INT_MAX */
+} RangeWorker;
+
+uint64_t wall_ns(void);
+double wall_ms(void);
+int range_check_missing_naive_mt(int* seq, size_t len, int nthreads);
+int range_check_missing_sort_mt(int* seq, size_t len, int nthreads);
+int range_check_missing_checksum_mt(int* seq, size_t len, int nthreads);
+
+/* File input: raw little-endian int32 dumps, checked without copying to the heap */
+#define RANGE_CHUNK_BYTES (8u << 20)
+
+int range_check_missing_file(const char* path, int nthreads, uint64_t* bytes_read);
+
+/* Every missing value in [min, max]: a bitset over the range, or a sorted copy
+ * when the range is more than RANGE_SPARSE_FACTOR bits per element wide */
+#define RANGE_SPARSE_FACTOR 32
+
+size_t range_find_missing_k(const int* seq, size_t len, int* missing, size_t max_missing);
+
+/* Online tracker: the checksum math kept as running totals so the missing
+ * value can be asked for at any point of a stream. The XOR of the values is
+ * kept next to the sum to tell "exactly one missing" from anything else. */
+typedef __int128 int128_t;
+
+typedef struct RangeTracker {
+  int64_t min;
+  int64_t max;
+  int128_t sum;
+  uint32_t xor;
+  uint64_t count;
+} RangeTracker;
+
+enum { TRACKER_COMPLETE, TRACKER_ONE_MISSING, TRACKER_INCONSISTENT };
+
+void range_tracker_init(RangeTracker* tracker);
+void range_tracker_push(RangeTracker* tracker, int value);
+void range_tracker_push_batch(RangeTracker* tracker, const int* values, size_t len);
+int range_tracker_query(const RangeTracker* tracker, int* missing);
+
+/* Generator: xoshiro256** with unbiased bounded draws and explicit seeds.
+ * Fills run on gen->nthreads threads and reuse the caller's buffer. */
+#define RANGE_GEN_BLOCKS 64
+
+typedef struct Rng {
+  uint64_t s[4];
+} Rng;
+
+typedef struct RangeGen {
+  uint64_t seed;
+  uint64_t fills;   /* every fill draws from fresh streams */
+  int nthreads;
+  Rng rng;          /* sequential draws: start values, skip positions */
+  int* out;
+  int beg;
+  size_t skip;
+  size_t block_beg[RANGE_GEN_BLOCKS + 1];
+  size_t bucket_beg[RANGE_GEN_BLOCKS + 1];
+  size_t count[RANGE_GEN_BLOCKS][RANGE_GEN_BLOCKS];
+} RangeGen;
+
+typedef struct RangeGenWorker {
+  RangeGen* gen;
+  int thread;
+  void (*phase)(RangeGen* gen, int block);
+} RangeGenWorker;
+
+void rng_seed(Rng* rng, uint64_t seed);
+uint64_t rng_next(Rng* rng);
+uint32_t rng_bounded(Rng* rng, uint32_t range);
+void range_gen_init(RangeGen* gen, uint64_t seed, int nthreads);
+int range_gen_int(RangeGen* gen, int lo, int hi);
+void range_gen_fill(RangeGen* gen, int* seq, size_t len, int beg);
+
+/* Optional perf_event_open counters around each timed region (-p) */
+#define PERF_NCOUNTERS 5
+
+typedef struct PerfCounters {
+  int enabled;                      /* at least one counter opened */
+  int fd[PERF_NCOUNTERS];           /* -1 when unavailable */
+  uint64_t value[PERF_NCOUNTERS];   /* accumulated over perf_start/perf_stop pairs */
+} PerfCounters;
+
+static const char* perf_names[PERF_NCOUNTERS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+void perf_open(PerfCounters* perf);
+void perf_start(PerfCounters* perf);
+void perf_stop(PerfCounters* perf);
+void perf_close(PerfCounters* perf);
+
 int
 range_check_missing_naive(int* seq, size_t len) {
   int min = *seq, max = *seq;
@@ -66,23 +228,178 @@ range_check_missing_naive(int* seq, size_t len) {
 int
 range_check_missing_sort(int* seq, size_t len) {
 
-  qsort(seq, len, sizeof(*seq), comp);
+  range_sort(seq, len);
+  return range_sort_gap_scan(seq, len);
+}
 
-  for (int* ptr_end = seq + len - 1; seq != ptr_end; seq++) {
+int
+range_sort_gap_scan(const int* seq, size_t len) {
+  for (const int* ptr_end = seq + len - 1; seq != ptr_end; seq++) {
     if (*(seq+1) != *seq + 1) return *seq + 1;
   }
   return TRUE;
 }
 
+/* Cheap guess, not a proof: the span must fit one gap at most and
+ * PRESORTED_SAMPLES evenly spaced neighbours must be in order */
+int
+range_is_sorted_sampled(const int* seq, size_t len) {
+  if (len < 2) return TRUE;
+
+  int64_t span = (int64_t) seq[len-1] - seq[0];
+  if (span != (int64_t) len - 1 && span != (int64_t) len) return FALSE;
+
+  size_t step = (len - 1) / PRESORTED_SAMPLES + 1;
+  for (size_t i = 0; i + 1 < len; i += step) {
+    if (seq[i+1] <= seq[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+/* First index where seq[i] != seq[0] + i, everything before it is gap-free */
+static size_t
+_range_first_gap(const int* seq, size_t lo, size_t hi) {
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((int64_t) seq[mid] == (int64_t) seq[0] + (int64_t) mid) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int
+range_check_missing_presorted(int* seq, size_t len) {
+
+  if (!range_is_sorted_sampled(seq, len)) return range_check_missing_sort(seq, len);
+
+  size_t i = _range_first_gap(seq, 0, len);
+  if (i == len) return TRUE;
+  return seq[0] + (int) i;
+}
+
+/* For sorted streams that grow by appending blocks: *checked is a prefix
+ * already known to be gap-free. Gallop 1, 2, 4, ... past it and binary search
+ * the last step, so the cost is O(log distance to the gap). */
+int
+range_check_missing_gallop(const int* seq, size_t len, size_t* checked) {
+
+  size_t lo = (*checked < len) ? *checked : len;
+  size_t step = 1;
+
+  while (lo + step < len && (int64_t) seq[lo + step] == (int64_t) seq[0] + (int64_t) (lo + step)) {
+    lo += step;
+    step <<= 1;
+  }
+
+  size_t hi = (lo + step < len) ? lo + step : len;
+  size_t i = _range_first_gap(seq, lo, hi);
+
+  *checked = i;
+  if (i == len) return TRUE;
+  return seq[0] + (int) i;
+}
+
+/* The sign bit is flipped so negative keys land in the low buckets. All
+ * histograms come out of one read pass (3 x 2048 counters stay in L1/L2) and
+ * a pass is skipped when every key has the same digit there, which is the
+ * usual case for the top digit of a small range. */
+void
+range_radix_sort(int* seq, size_t len, int* tmp) {
+
+  size_t hist[RADIX_PASSES][RADIX_BUCKETS];
+  memset(hist, 0, sizeof(hist));
+
+  for (const int *ptr = seq, *end_ptr = seq + len; ptr != end_ptr; ptr++) {
+    uint32_t u = (uint32_t) *ptr ^ 0x80000000u;
+    for (int p = 0; p < RADIX_PASSES; p++) {
+      hist[p][(u >> (p*RADIX_BITS)) & (RADIX_BUCKETS-1)]++;
+    }
+  }
+
+  int* src = seq;
+  int* dst = tmp;
+  for (int p = 0; p < RADIX_PASSES; p++) {
+    int shift = p*RADIX_BITS;
+    size_t* count = hist[p];
+
+    if (count[(((uint32_t) src[0] ^ 0x80000000u) >> shift) & (RADIX_BUCKETS-1)] == len) continue;
+
+    /* Exclusive prefix sum gives the first slot of each bucket */
+    size_t offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+
+    for (const int *ptr = src, *end_ptr = src + len; ptr != end_ptr; ptr++) {
+      uint32_t digit = (((uint32_t) *ptr ^ 0x80000000u) >> shift) & (RADIX_BUCKETS-1);
+      dst[count[digit]++] = *ptr;
+    }
+
+    int* swap_ptr = src;
+    src = dst;
+    dst = swap_ptr;
+  }
+
+  if (src != seq) memcpy(seq, src, len * sizeof(*seq));
+}
+
+/* (x > y) - (x < y): a - b overflows once the span passes INT_MAX, exactly
+ * the wide ranges that send range_find_missing_k to the sparse path */
+static int
+_range_cmp_int(const void *a, const void *b) {
+  int x = *(const int*) a, y = *(const int*) b;
+  return (x > y) - (x < y);
+}
+
+void
+range_sort(int* seq, size_t len) {
+
+  int* tmp = NULL;
+  if (range_sort_kind == RANGE_SORT_RADIX && len >= RADIX_MIN_LEN) {
+    tmp = malloc(len * sizeof(*seq));
+  }
+
+  if (tmp == NULL) {
+    qsort(seq, len, sizeof(*seq), _range_cmp_int);
+    return;
+  }
+
+  range_radix_sort(seq, len, tmp);
+  free(tmp);
+}
+
+int
+range_missing_from_stats(const RangeStats* stats) {
+
+  int64_t min = stats->min;
+  int64_t max = stats->max;
+
+  /* The Gauss Sum Can Get Really Big */
+  int64_t range_sum = (max*(max+1))/2  - min*(min-1)/2;
+
+  return range_sum-stats->sum;
+}
+
 int
 range_check_missing_checksum(int* seq, size_t len) {
 
+  RangeStats stats;
+  range_stats_kernel(seq, len, &stats);
+
+  return range_missing_from_stats(&stats);
+}
+
+void
+range_stats_scalar(const int* seq, size_t len, RangeStats* out) {
+
   int64_t min = seq[0];
   int64_t max = seq[0];
 
   int64_t arr_sum = 0;
 
-  for (int *ptr = seq, *end_ptr = seq + len; ptr != end_ptr; ptr++) {
+  for (const int *ptr = seq, *end_ptr = seq + len; ptr != end_ptr; ptr++) {
 
     if (*ptr < min) min = *ptr; 
     if (*ptr > max) max = *ptr; 
@@ -90,92 +407,1303 @@ range_check_missing_checksum(int* seq, size_t len) {
     arr_sum += *ptr;
   }
 
-  /* The Gauss Sum Can Get Really Big */
-  int64_t range_sum = (max*(max+1))/2  - min*(min-1)/2;
+  out->min = min;
+  out->max = max;
+  out->sum = arr_sum;
+}
 
-  return range_sum-arr_sum;
+#ifdef RANGE_HAVE_X86
+
+/* The vector kernels keep min/max in 32-bit lanes and widen every element
+ * to 64 bits before adding, so the result is bit-for-bit the scalar one.
+ * Whatever doesn't fill a whole vector is finished by the scalar loop. */
+
+static void
+range_stats_tail(const int* seq, size_t i, size_t len, RangeStats* out) {
+  for (; i < len; i++) {
+    if (seq[i] < out->min) out->min = seq[i];
+    if (seq[i] > out->max) out->max = seq[i];
+    out->sum += seq[i];
+  }
 }
 
-#define SEQSIZE 10000
-#define AVERAGE 10
-int random_seq[SEQSIZE];
-clock_t start, end;
-int missing_sum, missing_sorted, missing_naive;
-double time_sum = 0, time_sorted = 0, time_naive = 0;
+__attribute__((target("sse4.1")))
+void
+range_stats_sse41(const int* seq, size_t len, RangeStats* out) {
+
+  __m128i vmin = _mm_set1_epi32(seq[0]);
+  __m128i vmax = vmin;
+  __m128i vsum_lo = _mm_setzero_si128();
+  __m128i vsum_hi = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) (seq + i));
+    vmin = _mm_min_epi32(vmin, v);
+    vmax = _mm_max_epi32(vmax, v);
+    vsum_lo = _mm_add_epi64(vsum_lo, _mm_cvtepi32_epi64(v));
+    vsum_hi = _mm_add_epi64(vsum_hi, _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+  }
+
+  int32_t lane_min[4], lane_max[4];
+  int64_t lane_sum[2];
+  _mm_storeu_si128((__m128i*) lane_min, vmin);
+  _mm_storeu_si128((__m128i*) lane_max, vmax);
+  _mm_storeu_si128((__m128i*) lane_sum, _mm_add_epi64(vsum_lo, vsum_hi));
 
+  out->min = out->max = seq[0];
+  out->sum = lane_sum[0] + lane_sum[1];
+  for (int k = 0; k < 4; k++) {
+    if (lane_min[k] < out->min) out->min = lane_min[k];
+    if (lane_max[k] > out->max) out->max = lane_max[k];
+  }
+
+  range_stats_tail(seq, i, len, out);
+}
+
+__attribute__((target("avx2")))
+void
+range_stats_avx2(const int* seq, size_t len, RangeStats* out) {
+
+  __m256i vmin = _mm256_set1_epi32(seq[0]);
+  __m256i vmax = vmin;
+  __m256i vsum_lo = _mm256_setzero_si256();
+  __m256i vsum_hi = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*) (seq + i));
+    vmin = _mm256_min_epi32(vmin, v);
+    vmax = _mm256_max_epi32(vmax, v);
+    vsum_lo = _mm256_add_epi64(vsum_lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    vsum_hi = _mm256_add_epi64(vsum_hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+
+  int32_t lane_min[8], lane_max[8];
+  int64_t lane_sum[4];
+  _mm256_storeu_si256((__m256i*) lane_min, vmin);
+  _mm256_storeu_si256((__m256i*) lane_max, vmax);
+  _mm256_storeu_si256((__m256i*) lane_sum, _mm256_add_epi64(vsum_lo, vsum_hi));
+
+  out->min = out->max = seq[0];
+  out->sum = lane_sum[0] + lane_sum[1] + lane_sum[2] + lane_sum[3];
+  for (int k = 0; k < 8; k++) {
+    if (lane_min[k] < out->min) out->min = lane_min[k];
+    if (lane_max[k] > out->max) out->max = lane_max[k];
+  }
+
+  range_stats_tail(seq, i, len, out);
+}
+
+__attribute__((target("avx512f")))
+void
+range_stats_avx512(const int* seq, size_t len, RangeStats* out) {
+
+  __m512i vmin = _mm512_set1_epi32(seq[0]);
+  __m512i vmax = vmin;
+  __m512i vsum_lo = _mm512_setzero_si512();
+  __m512i vsum_hi = _mm512_setzero_si512();
+
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m512i v = _mm512_loadu_si512((const void*) (seq + i));
+    vmin = _mm512_min_epi32(vmin, v);
+    vmax = _mm512_max_epi32(vmax, v);
+    vsum_lo = _mm512_add_epi64(vsum_lo, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+    vsum_hi = _mm512_add_epi64(vsum_hi, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+  }
+
+  out->min = _mm512_reduce_min_epi32(vmin);
+  out->max = _mm512_reduce_max_epi32(vmax);
+  out->sum = _mm512_reduce_add_epi64(_mm512_add_epi64(vsum_lo, vsum_hi));
+
+  range_stats_tail(seq, i, len, out);
+}
+
+#endif /* RANGE_HAVE_X86 */
+
+/* Pick the widest kernel the CPU supports, returns its name for the log */
+const char*
+range_stats_dispatch(void) {
+#ifdef RANGE_HAVE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    range_stats_kernel = range_stats_avx512;
+    return "AVX-512";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    range_stats_kernel = range_stats_avx2;
+    return "AVX2";
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    range_stats_kernel = range_stats_sse41;
+    return "SSE4.1";
+  }
+#endif
+  range_stats_kernel = range_stats_scalar;
+  return "Scalar";
+}
+
+/* Writes the first max_missing holes into missing[], returns how many there are */
+static size_t
+_range_find_missing_dense(const int* seq, size_t len, const RangeStats* stats, int* missing, size_t max_missing) {
+
+  size_t range = stats->max - stats->min + 1;
+  size_t words = (range + 63) / 64;
+  uint64_t* bitmap = calloc(words, sizeof(uint64_t));
+  if (bitmap == NULL) {
+    perror("Failed to allocate bitmap.");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Bits past max are set so they never count as missing */
+  if (range % 64) bitmap[words-1] |= ~(uint64_t) 0 << (range % 64);
+
+  for (const int *ptr = seq, *end_ptr = seq + len; ptr != end_ptr; ptr++) {
+    uint64_t bit = (uint64_t) (*ptr - stats->min);
+    bitmap[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+  }
+
+  size_t count = 0;
+  for (size_t k = 0; k < words; k++) {
+    uint64_t holes = ~bitmap[k];
+    while (holes) {
+      if (count < max_missing) missing[count] = stats->min + 64*(int64_t) k + __builtin_ctzll(holes);
+      count++;
+      holes &= holes - 1;
+    }
+  }
+
+  free(bitmap);
+  return count;
+}
+
+static size_t
+_range_find_missing_sparse(const int* seq, size_t len, int* missing, size_t max_missing) {
+
+  int* sorted = malloc(len * sizeof(*seq));
+  if (sorted == NULL) {
+    perror("Failed to allocate sorted copy.");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(sorted, seq, len * sizeof(*seq));
+  range_sort(sorted, len);
+
+  /* Whole gaps are counted at once, values are only written up to max_missing */
+  size_t count = 0;
+  for (size_t i = 1; i < len; i++) {
+    if (sorted[i] == sorted[i-1]) continue;
+    int64_t v = (int64_t) sorted[i-1] + 1;
+    for (; v < sorted[i] && count < max_missing; v++)
+      missing[count++] = v;
+    count += sorted[i] - v;
+  }
+
+  free(sorted);
+  return count;
+}
+
+size_t
+range_find_missing_k(const int* seq, size_t len, int* missing, size_t max_missing) {
+
+  if (len == 0) return 0;
+
+  RangeStats stats;
+  range_stats_kernel(seq, len, &stats);
+
+  uint64_t range = stats.max - stats.min + 1;
+  if (range / RANGE_SPARSE_FACTOR > len) {
+    return _range_find_missing_sparse(seq, len, missing, max_missing);
+  }
+  return _range_find_missing_dense(seq, len, &stats, missing, max_missing);
+}
+
+void
+range_tracker_init(RangeTracker* tracker) {
+  *tracker = (RangeTracker) {INT64_MAX, INT64_MIN, 0, 0, 0};
+}
+
+void
+range_tracker_push(RangeTracker* tracker, int value) {
+  if (value < tracker->min) tracker->min = value;
+  if (value > tracker->max) tracker->max = value;
+  tracker->sum += value;
+  tracker->xor ^= (uint32_t) value;
+  tracker->count++;
+}
+
+/* min/max/sum through the dispatched SIMD kernel, XOR two ints per 64-bit
+ * word in a loop the compiler vectorizes */
+void
+range_tracker_push_batch(RangeTracker* tracker, const int* values, size_t len) {
+  if (len == 0) return;
+
+  RangeStats stats;
+  range_stats_kernel(values, len, &stats);
+
+  uint64_t wide = 0;
+  size_t pairs = len / 2;
+  for (size_t k = 0; k < pairs; k++) {
+    uint64_t word;
+    memcpy(&word, values + 2*k, sizeof(word));
+    wide ^= word;
+  }
+  uint32_t xor = (uint32_t) wide ^ (uint32_t) (wide >> 32);
+  if (len % 2) xor ^= (uint32_t) values[len-1];
+
+  if (stats.min < tracker->min) tracker->min = stats.min;
+  if (stats.max > tracker->max) tracker->max = stats.max;
+  tracker->sum += stats.sum;
+  tracker->xor ^= xor;
+  tracker->count += len;
+}
+
+/* XOR of 0..n */
+static uint32_t
+_xor_upto(uint32_t n) {
+  switch (n & 3) {
+    case 0: return n;
+    case 1: return 1;
+    case 2: return n + 1;
+    default: return 0;
+  }
+}
+
+/* XOR of every int in [a, b], done on the two's complement bit patterns */
+static uint32_t
+_xor_range(int64_t a, int64_t b) {
+  uint32_t ua = (uint32_t) a;
+  uint32_t ub = (uint32_t) b;
+  uint32_t below_a = ua ? _xor_upto(ua - 1) : 0;
+
+  /* a < 0 <= b wraps around: [ua, 0xFFFFFFFF] and [0, ub], XOR of 0..0xFFFFFFFF is 0 */
+  return _xor_upto(ub) ^ below_a;
+}
+
+/* O(1). TRACKER_ONE_MISSING only when the sum and the XOR agree on the value */
 int
-main() {
+range_tracker_query(const RangeTracker* tracker, int* missing) {
+  if (tracker->count == 0) return TRACKER_INCONSISTENT;
 
-  /* Random seed */
-  (void) srand(time(NULL));
-  (void) printf("Array Size: %d\nIterations per Algorithm: %d\n", SEQSIZE, AVERAGE);
+  int128_t min = tracker->min;
+  int128_t max = tracker->max;
+  int128_t range_sum = (max*(max+1))/2  - min*(min-1)/2;
+  int128_t diff = range_sum - tracker->sum;
+  uint64_t range = tracker->max - tracker->min + 1;
 
-  for (int i = 1; i <= AVERAGE; i++) {
-    (void) range_missing_fill(random_seq, SEQSIZE, RAND(-1000, 1000) );
-    (void) printf("Iteration: %d\n", i);
+  if (diff == 0 && range == tracker->count) return TRACKER_COMPLETE;
+  if (range != tracker->count + 1) return TRACKER_INCONSISTENT;
 
-    start = clock();
-    missing_naive = range_check_missing_naive(random_seq, SEQSIZE);
-    end = clock();
-    time_naive += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+  uint32_t xor_missing = _xor_range(tracker->min, tracker->max) ^ tracker->xor;
+  if (diff < min || diff > max || (uint32_t) (int) diff != xor_missing) return TRACKER_INCONSISTENT;
 
-    start = clock();
-    missing_sum = range_check_missing_checksum(random_seq, SEQSIZE);
-    end = clock();
-    time_sum += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+  *missing = (int) diff;
+  return TRACKER_ONE_MISSING;
+}
 
-    start = clock();
-    missing_sorted = range_check_missing_sort(random_seq, SEQSIZE);
-    end = clock();
-    time_sorted += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+/* Spawns nthreads-1 threads and runs worker 0 on the calling thread */
+static void
+range_parallel_run(void* (*fn)(void*), void* workers, size_t worker_size, int nthreads) {
+  pthread_t tid[MAX_THREADS];
+  char* worker = workers;
 
-    if (i == AVERAGE) {
-      (void) puts(" --- FINAL AVERAGE --- ");
+  for (int t = 1; t < nthreads; t++) {
+    if (pthread_create(&tid[t], NULL, fn, worker + t*worker_size) != 0) {
+      perror("Failed to create thread.");
+      exit(EXIT_FAILURE);
     }
-    (void) printf("| Algorithm | Missing | Avg. Time (ms) |\n| Naive     | %7d | %14.3lf |\n| Sorted    | %7d | %14.3lf |\n| Linear    | %7d | %14.3lf |\n",
-                  missing_naive, time_naive/i, missing_sorted, time_sorted/i, missing_sum, time_sum/i) ;
   }
+  (void) fn(worker);
+  for (int t = 1; t < nthreads; t++) {
+    (void) pthread_join(tid[t], NULL);
+  }
+}
+
+/* Equal chunks, the first len % nthreads chunks get one extra element */
+static int
+range_split(RangeWorker* workers, int* seq, size_t len, int nthreads) {
+  if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+  if ((size_t) nthreads > len) nthreads = len;
+  if (nthreads < 1) nthreads = 1;
+
+  size_t chunk = len / nthreads;
+  size_t extra = len % nthreads;
+  for (int t = 0; t < nthreads; t++) {
+    workers[t] = (RangeWorker) {0};
+    workers[t].seq = seq;
+    workers[t].len = chunk + ((size_t) t < extra);
+    workers[t].all = workers;
+    workers[t].nthreads = nthreads;
+    seq += workers[t].len;
+  }
+  return nthreads;
+}
 
+static void*
+_range_stats_worker(void* arg) {
+  RangeWorker* w = arg;
+  range_stats_kernel(w->seq, w->len, &w->stats);
+  return NULL;
+}
+
+static RangeStats
+range_stats_mt(RangeWorker* workers, int nthreads) {
+  range_parallel_run(_range_stats_worker, workers, sizeof(*workers), nthreads);
+
+  RangeStats total = workers[0].stats;
+  for (int t = 1; t < nthreads; t++) {
+    if (workers[t].stats.min < total.min) total.min = workers[t].stats.min;
+    if (workers[t].stats.max > total.max) total.max = workers[t].stats.max;
+    total.sum += workers[t].stats.sum;
+  }
+  return total;
 }
 
 int
-comp(const void *a, const void *b) {
-  return (*(int *)a - *(int *)b);
+range_check_missing_checksum_mt(int* seq, size_t len, int nthreads) {
+
+  RangeWorker workers[MAX_THREADS];
+  nthreads = range_split(workers, seq, len, nthreads);
+  RangeStats stats = range_stats_mt(workers, nthreads);
+
+  return range_missing_from_stats(&stats);
+}
+
+static void*
+_range_bitmap_worker(void* arg) {
+  RangeWorker* w = arg;
+  for (int *ptr = w->seq, *end_ptr = w->seq + w->len; ptr != end_ptr; ptr++) {
+    uint64_t bit = (uint64_t) (*ptr - w->base);
+    w->bitmap[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+  }
+  return NULL;
+}
+
+/* OR every partial bitmap over this thread's word slice, then look for a hole */
+static void*
+_range_bitmap_merge_worker(void* arg) {
+  RangeWorker* w = arg;
+  w->missing = INT_MAX;
+
+  for (size_t k = w->first_word; k < w->last_word; k++) {
+    uint64_t word = 0;
+    for (int t = 0; t < w->nthreads; t++) {
+      word |= w->all[t].bitmap[k];
+    }
+    w->all[0].bitmap[k] = word;
+    if (~word != 0) {
+      w->missing = w->base + 64*(int64_t) k + __builtin_ctzll(~word);
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+int
+range_check_missing_naive_mt(int* seq, size_t len, int nthreads) {
+
+  RangeWorker workers[MAX_THREADS];
+  nthreads = range_split(workers, seq, len, nthreads);
+  RangeStats stats = range_stats_mt(workers, nthreads);
+
+  /* Bits past max are set so they never count as missing */
+  size_t range = stats.max - stats.min + 1;
+  size_t words = (range + 63) / 64;
+
+  for (int t = 0; t < nthreads; t++) {
+    workers[t].bitmap = calloc(words, sizeof(uint64_t));
+    if (workers[t].bitmap == NULL) {
+      perror("Failed to allocate bitmap.");
+      exit(EXIT_FAILURE);
+    }
+    workers[t].base = stats.min;
+    workers[t].words = words;
+  }
+  if (range % 64) workers[0].bitmap[words-1] |= ~(uint64_t) 0 << (range % 64);
+
+  range_parallel_run(_range_bitmap_worker, workers, sizeof(*workers), nthreads);
+
+  for (int t = 0; t < nthreads; t++) {
+    workers[t].first_word = words * t / nthreads;
+    workers[t].last_word = words * (t+1) / nthreads;
+  }
+  range_parallel_run(_range_bitmap_merge_worker, workers, sizeof(*workers), nthreads);
+
+  int missing = TRUE;
+  for (int t = 0; t < nthreads; t++) {
+    if (workers[t].missing != INT_MAX) {
+      missing = workers[t].missing;
+      break;
+    }
+  }
+
+  for (int t = 0; t < nthreads; t++) {
+    free(workers[t].bitmap);
+  }
+  return missing;
+}
+
+static void*
+_range_sort_worker(void* arg) {
+  RangeWorker* w = arg;
+  range_sort(w->seq, w->len);
+  return NULL;
+}
+
+/* Merge two sorted runs that sit back to back in w->all[0..1] into w->seq */
+static void*
+_range_merge_worker(void* arg) {
+  RangeWorker* w = arg;
+  int *a = w->all[0].seq, *a_end = a + w->all[0].len;
+  int *b = w->all[1].seq, *b_end = b + w->all[1].len;
+  int *dst = w->seq;
+
+  while (a != a_end && b != b_end) *dst++ = (*b < *a) ? *b++ : *a++;
+  while (a != a_end) *dst++ = *a++;
+  while (b != b_end) *dst++ = *b++;
+  return NULL;
+}
+
+int
+range_check_missing_sort_mt(int* seq, size_t len, int nthreads) {
+
+  RangeWorker runs[MAX_THREADS];
+  nthreads = range_split(runs, seq, len, nthreads);
+  range_parallel_run(_range_sort_worker, runs, sizeof(*runs), nthreads);
+
+  int* tmp = malloc(len * sizeof(*seq));
+  if (tmp == NULL) {
+    perror("Failed to allocate merge buffer.");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Pairwise merge rounds, each pair merged by its own thread */
+  int* src = seq;
+  int* dst = tmp;
+  int nruns = nthreads;
+  while (nruns > 1) {
+    RangeWorker merges[MAX_THREADS];
+    int nmerges = 0;
+    int* out = dst;
+
+    for (int r = 0; r < nruns; r += 2) {
+      merges[nmerges] = (RangeWorker) {0};
+      merges[nmerges].seq = out;
+      merges[nmerges].all = &runs[r];
+      if (r + 1 == nruns) runs[r+1] = (RangeWorker) {.seq = runs[r].seq + runs[r].len, .len = 0};
+      out += runs[r].len + runs[r+1].len;
+      nmerges++;
+    }
+    range_parallel_run(_range_merge_worker, merges, sizeof(*merges), nmerges);
+
+    for (int m = 0; m < nmerges; m++) {
+      runs[m].len = merges[m].all[0].len + merges[m].all[1].len;
+      runs[m].seq = merges[m].seq;
+    }
+    nruns = nmerges;
+
+    int* swap_ptr = src;
+    src = dst;
+    dst = swap_ptr;
+  }
+  if (src != seq) memcpy(seq, src, len * sizeof(*seq));
+  free(tmp);
+
+  return range_sort_gap_scan(seq, len);
+}
+
+/* Streaming fallback for when the file can't be mapped (pipes, big-endian hosts) */
+static void
+range_stats_stream(int fd, RangeStats* total, uint64_t* bytes_read) {
+
+  void* mem = NULL;
+  if (posix_memalign(&mem, 4096, RANGE_CHUNK_BYTES) != 0) {
+    perror("Failed to allocate read buffer.");
+    exit(EXIT_FAILURE);
+  }
+  unsigned char* buf = mem;
+  size_t carry = 0;
+  int first = TRUE;
+
+  *bytes_read = 0;
+  for (;;) {
+    ssize_t got = read(fd, buf + carry, RANGE_CHUNK_BYTES - carry);
+    if (got < 0) {
+      perror("Failed to read input file.");
+      exit(EXIT_FAILURE);
+    }
+    if (got == 0) break;
+    *bytes_read += got;
+
+    size_t avail = carry + got;
+    size_t count = avail / sizeof(int32_t);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t k = 0; k < count; k++) {
+      uint32_t v;
+      memcpy(&v, buf + 4*k, 4);
+      v = __builtin_bswap32(v);
+      memcpy(buf + 4*k, &v, 4);
+    }
+#endif
+
+    if (count > 0) {
+      RangeStats part;
+      range_stats_kernel((const int*) buf, count, &part);
+      if (first) {
+        *total = part;
+        first = FALSE;
+      } else {
+        if (part.min < total->min) total->min = part.min;
+        if (part.max > total->max) total->max = part.max;
+        total->sum += part.sum;
+      }
+    }
+
+    /* Keep a partial int32 for the next read */
+    carry = avail - count*sizeof(int32_t);
+    memmove(buf, buf + count*sizeof(int32_t), carry);
+  }
+
+  if (first) {
+    (void) puts("Input file has no complete int32.");
+    exit(EXIT_FAILURE);
+  }
+  free(mem);
+}
+
+int
+range_check_missing_file(const char* path, int nthreads, uint64_t* bytes_read) {
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Failed to open input file.");
+    exit(EXIT_FAILURE);
+  }
+
+  RangeStats stats;
+  struct stat st;
+  void* map = MAP_FAILED;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= (off_t) sizeof(int32_t)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+#endif
+
+  if (map != MAP_FAILED) {
+    (void) posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    /* Trailing bytes that don't make a whole int32 are ignored */
+    size_t len = st.st_size / sizeof(int32_t);
+    RangeWorker workers[MAX_THREADS];
+    nthreads = range_split(workers, (int*) map, len, nthreads);
+    stats = range_stats_mt(workers, nthreads);
+
+    *bytes_read = len * sizeof(int32_t);
+    (void) munmap(map, st.st_size);
+  } else {
+    range_stats_stream(fd, &stats, bytes_read);
+  }
+
+  (void) close(fd);
+  return range_missing_from_stats(&stats);
+}
+
+/* ===== DATA GENERATOR ===== */
+
+/* splitmix64, only used to expand seeds */
+static uint64_t
+_splitmix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15u);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+  return z ^ (z >> 31);
 }
 
 void
-print_arr(int* arr, int len) {
-  for (int* ptr = arr; ptr != arr+len; ptr++) {
-    printf("%d ", *ptr);
+rng_seed(Rng* rng, uint64_t seed) {
+  for (int k = 0; k < 4; k++) rng->s[k] = _splitmix64(&seed);
+}
+
+/* xoshiro256** */
+uint64_t
+rng_next(Rng* rng) {
+  uint64_t* s = rng->s;
+  uint64_t x = s[1] * 5;
+  uint64_t result = ((x << 7) | (x >> 57)) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 45) | (s[3] >> 19);
+  return result;
+}
+
+/* Lemire's multiply-shift, uniform in [0, range) without the modulo bias of rand() % range */
+uint32_t
+rng_bounded(Rng* rng, uint32_t range) {
+  uint64_t m = (uint64_t) (uint32_t) (rng_next(rng) >> 32) * range;
+  uint32_t low = (uint32_t) m;
+
+  if (low < range) {
+    uint32_t threshold = -range % range;
+    while (low < threshold) {
+      m = (uint64_t) (uint32_t) (rng_next(rng) >> 32) * range;
+      low = (uint32_t) m;
+    }
   }
-  putc('\n', stdout);
+  return m >> 32;
+}
+
+/* Every block and bucket gets its own stream derived from (seed, fill, stream) */
+static void
+_range_gen_stream(const RangeGen* gen, Rng* rng, uint64_t stream) {
+  rng_seed(rng, gen->seed ^ (gen->fills * 0xD1B54A32D192ED03u) ^ (stream * 0x8CB92BA72F3D8DD7u));
 }
 
 void
-range_missing_fill(int* seq, size_t len, int beg) {
+range_gen_init(RangeGen* gen, uint64_t seed, int nthreads) {
+  *gen = (RangeGen) {0};
+  gen->seed = seed;
+  gen->nthreads = (nthreads < 1) ? 1 : (nthreads > MAX_THREADS) ? MAX_THREADS : nthreads;
+  _range_gen_stream(gen, &gen->rng, 2*RANGE_GEN_BLOCKS);
+}
+
+int
+range_gen_int(RangeGen* gen, int lo, int hi) {
+  return lo + (int) rng_bounded(&gen->rng, (uint32_t) (hi - lo) + 1);
+}
+
+/* Value at position i of the sorted sequence, skip is where the hole goes */
+static inline int
+_range_gen_value(const RangeGen* gen, size_t i) {
+  return gen->beg + (int) i + (i > gen->skip);
+}
+
+/* Source block b: which bucket every element goes to */
+static void
+_range_gen_count(RangeGen* gen, int b) {
+  Rng rng;
+  _range_gen_stream(gen, &rng, b);
+  size_t* count = gen->count[b];
+  memset(count, 0, sizeof(gen->count[b]));
 
-  int *ptr; 
-  int *end = seq + len;
-  size_t i = beg;
+  for (size_t i = gen->block_beg[b]; i < gen->block_beg[b+1]; i++) {
+    count[rng_bounded(&rng, RANGE_GEN_BLOCKS)]++;
+  }
+}
 
-  /* Increment twice at this address */
-  int* skip_ptr = seq + RAND(1, len-2);
+/* Replays the same draws as _range_gen_count and writes the values out */
+static void
+_range_gen_scatter(RangeGen* gen, int b) {
+  Rng rng;
+  _range_gen_stream(gen, &rng, b);
+  size_t* offset = gen->count[b];
 
-  /* O(n) fill the array*/
-  for (ptr = seq; ptr != end; ptr++) {
-    *ptr = i;
-    i++;
-    if (ptr == skip_ptr) i++;
+  for (size_t i = gen->block_beg[b]; i < gen->block_beg[b+1]; i++) {
+    gen->out[offset[rng_bounded(&rng, RANGE_GEN_BLOCKS)]++] = _range_gen_value(gen, i);
   }
+}
 
-  /* Shuffle it arround in O(n) */
-  for (size_t i = len - 1; i > 0; i--) {
-    size_t j = RAND(0, i);
+/* Fisher-Yates inside bucket k */
+static void
+_range_gen_shuffle(RangeGen* gen, int k) {
+  Rng rng;
+  _range_gen_stream(gen, &rng, RANGE_GEN_BLOCKS + k);
+  int* seq = gen->out + gen->bucket_beg[k];
+  size_t len = gen->bucket_beg[k+1] - gen->bucket_beg[k];
 
-    /* Swap Elements */
-    int temp = seq[i];
-    seq[i] = seq[j];
+  for (size_t i = len; i > 1; i--) {
+    size_t j = rng_bounded(&rng, (uint32_t) i);
+    int temp = seq[i-1];
+    seq[i-1] = seq[j];
     seq[j] = temp;
   }
+}
+
+static void*
+_range_gen_worker(void* arg) {
+  RangeGenWorker* w = arg;
+  for (int b = w->thread; b < RANGE_GEN_BLOCKS; b += w->gen->nthreads) {
+    w->phase(w->gen, b);
+  }
+  return NULL;
+}
+
+static void
+_range_gen_phase(RangeGen* gen, void (*phase)(RangeGen*, int)) {
+  RangeGenWorker workers[MAX_THREADS] = {{0}};
+  int nthreads = (gen->nthreads < RANGE_GEN_BLOCKS) ? gen->nthreads : RANGE_GEN_BLOCKS;
+  for (int t = 0; t < nthreads; t++) {
+    workers[t] = (RangeGenWorker) {gen, t, phase};
+  }
+  range_parallel_run(_range_gen_worker, workers, sizeof(*workers), nthreads);
+}
+
+/* beg, beg+1, ... with one value skipped, uniformly shuffled. Sorted order is
+ * cut in RANGE_GEN_BLOCKS source blocks, every element is sent to a random
+ * bucket, then each bucket is shuffled on its own (Sanders' parallel
+ * permutation). The block count doesn't depend on the thread count, so one
+ * seed gives the same sequence with any number of threads. */
+void
+range_gen_fill(RangeGen* gen, int* seq, size_t len, int beg) {
+
+  gen->out = seq;
+  gen->beg = beg;
+  gen->skip = rng_bounded(&gen->rng, (uint32_t) (len - 2));
+
+  for (int b = 0; b <= RANGE_GEN_BLOCKS; b++) {
+    gen->block_beg[b] = len * b / RANGE_GEN_BLOCKS;
+  }
+  _range_gen_phase(gen, _range_gen_count);
+
+  /* Bucket k holds, in block order, what every source block sent to it */
+  size_t offset = 0;
+  for (int k = 0; k < RANGE_GEN_BLOCKS; k++) {
+    gen->bucket_beg[k] = offset;
+    for (int b = 0; b < RANGE_GEN_BLOCKS; b++) {
+      size_t c = gen->count[b][k];
+      gen->count[b][k] = offset;
+      offset += c;
+    }
+  }
+  gen->bucket_beg[RANGE_GEN_BLOCKS] = offset;
+
+  _range_gen_phase(gen, _range_gen_scatter);
+  _range_gen_phase(gen, _range_gen_shuffle);
+  gen->fills++;
+}
+
+/* ===== HARDWARE COUNTERS ===== */
+#ifdef __linux__
+
+static int
+_perf_event_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.inherit = 1;         /* count the worker threads too */
+  attr.exclude_kernel = 1;  /* allowed with perf_event_paranoid = 2 */
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Opens what it can, counters the kernel or the VM refuses just stay off */
+void
+perf_open(PerfCounters* perf) {
+  static const uint32_t type[PERF_NCOUNTERS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+  };
+  static const uint64_t config[PERF_NCOUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+  perf->enabled = FALSE;
+  for (int c = 0; c < PERF_NCOUNTERS; c++) {
+    perf->fd[c] = _perf_event_open(type[c], config[c]);
+    perf->value[c] = 0;
+    if (perf->fd[c] >= 0) perf->enabled = TRUE;
+  }
+}
+
+void
+perf_start(PerfCounters* perf) {
+  for (int c = 0; c < PERF_NCOUNTERS; c++) {
+    if (perf->fd[c] < 0) continue;
+    (void) ioctl(perf->fd[c], PERF_EVENT_IOC_RESET, 0);
+    (void) ioctl(perf->fd[c], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+/* Adds the counts since perf_start to perf->value */
+void
+perf_stop(PerfCounters* perf) {
+  for (int c = 0; c < PERF_NCOUNTERS; c++) {
+    uint64_t count;
+    if (perf->fd[c] < 0) continue;
+    (void) ioctl(perf->fd[c], PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perf->fd[c], &count, sizeof(count)) == sizeof(count)) perf->value[c] += count;
+  }
+}
+
+void
+perf_close(PerfCounters* perf) {
+  for (int c = 0; c < PERF_NCOUNTERS; c++) {
+    if (perf->fd[c] >= 0) (void) close(perf->fd[c]);
+    perf->fd[c] = -1;
+  }
+  perf->enabled = FALSE;
+}
+
+#else
+
+void perf_open(PerfCounters* perf) { for (int c = 0; c < PERF_NCOUNTERS; c++) perf->fd[c] = -1; perf->enabled = FALSE; }
+void perf_start(PerfCounters* perf) { (void) perf; }
+void perf_stop(PerfCounters* perf) { (void) perf; }
+void perf_close(PerfCounters* perf) { (void) perf; }
+
+#endif /* __linux__ */
+
+/* Wall clock, clock() adds up the CPU time of every thread */
+uint64_t
+wall_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+double
+wall_ms(void) {
+  return wall_ns() / 1e6;
+}
+
+/* ===== BENCHMARK HARNESS ===== */
+#define BENCH_DEFAULT_LEN 10000
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUP 2
+#define BENCH_MAX_LIST 32
+#define NAIVE_MAX_LEN 100000  /* naive and rescan are quadratic, bigger sizes only when asked for with -a */
+#define TRACKER_BATCH 1000
+
+enum { BENCH_INPUT_SHUFFLED, BENCH_INPUT_SORTED };
+enum { BENCH_TABLE, BENCH_CSV, BENCH_JSON };
+
+typedef struct BenchAlgo {
+  const char* name;
+  int (*run)(int* seq, size_t len, int nthreads);
+  int input;      /* shuffled, or sorted before timing */
+  int threaded;   /* once per -t value, otherwise 1 thread only */
+  int quadratic;  /* skipped above NAIVE_MAX_LEN by default */
+  int sublinear;  /* doesn't read the whole input, so no GB/s */
+} BenchAlgo;
+
+typedef struct BenchResult {
+  const char* name;
+  size_t len;
+  int sublinear;
+  int nthreads;
+  int runs;
+  int missing;
+  int expected;
+  double min_ms;
+  double median_ms;
+  double p99_ms;
+  double speedup;  /* median at the first -t value over this median */
+  double counters[PERF_NCOUNTERS];  /* per run, -1 when unavailable */
+} BenchResult;
+
+/* Opened by -p, left disabled otherwise */
+static PerfCounters bench_perf = {FALSE, {-1, -1, -1, -1, -1}, {0}};
+
+static int _bench_naive(int* seq, size_t len, int nthreads) { (void) nthreads; return range_check_missing_naive(seq, len); }
+static int _bench_sort(int* seq, size_t len, int nthreads) { (void) nthreads; return range_check_missing_sort(seq, len); }
+static int _bench_gap_scan(int* seq, size_t len, int nthreads) { (void) nthreads; return range_sort_gap_scan(seq, len); }
+static int _bench_checksum(int* seq, size_t len, int nthreads) { (void) nthreads; return range_check_missing_checksum(seq, len); }
+static int _bench_presorted(int* seq, size_t len, int nthreads) { (void) nthreads; return range_check_missing_presorted(seq, len); }
+
+static int
+_bench_gallop(int* seq, size_t len, int nthreads) {
+  (void) nthreads;
+  size_t checked = 0;
+  return range_check_missing_gallop(seq, len, &checked);
+}
+
+static int
+_bench_all_k(int* seq, size_t len, int nthreads) {
+  (void) nthreads;
+  int first = TRUE;
+  (void) range_find_missing_k(seq, len, &first, 1);
+  return first;
+}
+
+/* Query after every TRACKER_BATCH values, the last answer is the result */
+static int
+_bench_tracker(int* seq, size_t len, int nthreads) {
+  (void) nthreads;
+  RangeTracker tracker;
+  int missing = TRUE;
+  range_tracker_init(&tracker);
+  for (size_t off = 0; off < len; off += TRACKER_BATCH) {
+    range_tracker_push_batch(&tracker, seq + off, (len - off < TRACKER_BATCH) ? len - off : TRACKER_BATCH);
+    (void) range_tracker_query(&tracker, &missing);
+  }
+  return missing;
+}
+
+/* What the tracker saves: the checksum finder re-run over the prefix after
+ * every TRACKER_BATCH values, O(n^2 / TRACKER_BATCH) */
+static int
+_bench_rescan(int* seq, size_t len, int nthreads) {
+  (void) nthreads;
+  int missing = TRUE;
+  for (size_t off = 0; off < len; off += TRACKER_BATCH) {
+    missing = range_check_missing_checksum(seq, (len - off < TRACKER_BATCH) ? len : off + TRACKER_BATCH);
+  }
+  return missing;
+}
+
+static const BenchAlgo bench_algos[] = {
+  {"naive",       _bench_naive,                    BENCH_INPUT_SHUFFLED, FALSE, TRUE , FALSE},
+  {"naive_mt",    range_check_missing_naive_mt,    BENCH_INPUT_SHUFFLED, TRUE,  FALSE, FALSE},
+  {"sort",        _bench_sort,                     BENCH_INPUT_SHUFFLED, FALSE, FALSE, FALSE},
+  {"gap_scan",    _bench_gap_scan,                 BENCH_INPUT_SORTED,   FALSE, FALSE, FALSE},
+  {"sort_mt",     range_check_missing_sort_mt,     BENCH_INPUT_SHUFFLED, TRUE,  FALSE, FALSE},
+  {"checksum",    _bench_checksum,                 BENCH_INPUT_SHUFFLED, FALSE, FALSE, FALSE},
+  {"checksum_mt", range_check_missing_checksum_mt, BENCH_INPUT_SHUFFLED, TRUE,  FALSE, FALSE},
+  {"presorted",   _bench_presorted,                BENCH_INPUT_SORTED,   FALSE, FALSE, TRUE },
+  {"gallop",      _bench_gallop,                   BENCH_INPUT_SORTED,   FALSE, FALSE, TRUE },
+  {"all_k",       _bench_all_k,                    BENCH_INPUT_SHUFFLED, FALSE, FALSE, FALSE},
+  {"tracker",     _bench_tracker,                  BENCH_INPUT_SHUFFLED, FALSE, FALSE, FALSE},
+  {"rescan",      _bench_rescan,                   BENCH_INPUT_SHUFFLED, FALSE, TRUE , FALSE},
+};
+#define BENCH_NALGOS ((int) (sizeof(bench_algos) / sizeof(bench_algos[0])))
+
+static int
+_bench_cmp_double(const void *a, const void *b) {
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/* min/median/p99 of the samples (sorts them in place) */
+static void
+bench_summarize(double* samples, int runs, BenchResult* res) {
+  qsort(samples, runs, sizeof(*samples), _bench_cmp_double);
+
+  int p99 = (99*runs + 99) / 100 - 1;
+  res->runs = runs;
+  res->min_ms = samples[0];
+  res->median_ms = (runs % 2) ? samples[runs/2] : (samples[runs/2 - 1] + samples[runs/2]) / 2;
+  res->p99_ms = samples[p99];
+}
+
+/* Average per run of what bench_perf counted */
+static void
+bench_counters(BenchResult* res, int runs) {
+  for (int c = 0; c < PERF_NCOUNTERS; c++) {
+    res->counters[c] = (bench_perf.fd[c] >= 0) ? (double) bench_perf.value[c] / runs : -1;
+  }
+}
+
+/* Every run gets a fresh copy of the input since sort and friends work in place */
+static void
+bench_run(const BenchAlgo* algo, const int* input, int* seq, size_t len, int nthreads,
+          int warmup, int runs, double* samples, BenchResult* res) {
+
+  memset(bench_perf.value, 0, sizeof(bench_perf.value));
+
+  for (int r = -warmup; r < runs; r++) {
+    memcpy(seq, input, len * sizeof(*seq));
+
+    if (r >= 0 && bench_perf.enabled) perf_start(&bench_perf);
+    uint64_t t0 = wall_ns();
+    res->missing = algo->run(seq, len, nthreads);
+    uint64_t t1 = wall_ns();
+    if (r >= 0 && bench_perf.enabled) perf_stop(&bench_perf);
+
+    if (r >= 0) samples[r] = (t1 - t0) / 1e6;
+  }
+  bench_counters(res, runs);
+
+  res->name = algo->name;
+  res->len = len;
+  res->sublinear = algo->sublinear;
+  res->nthreads = nthreads;
+  bench_summarize(samples, runs, res);
+}
+
+static void
+bench_print_header(int format) {
+  if (format == BENCH_CSV) {
+    (void) printf("algorithm,n,threads,runs,missing,ok,min_ms,median_ms,p99_ms,gbps,speedup");
+    for (int c = 0; bench_perf.enabled && c < PERF_NCOUNTERS; c++) (void) printf(",%s", perf_names[c]);
+    (void) puts("");
+  } else if (format == BENCH_JSON) {
+    (void) puts("[");
+  } else {
+    (void) printf("| Algorithm   |         N | Threads | Missing | OK | Min (ms) | Median (ms) | P99 (ms) | GB/s    | Speedup |");
+    for (int c = 0; bench_perf.enabled && c < PERF_NCOUNTERS; c++) (void) printf(" %13s |", perf_names[c]);
+    (void) puts("");
+  }
+}
+
+/* Counters per run next to the timing, blank (CSV), null (JSON) or - (table) when unavailable */
+static void
+bench_print_counters(int format, const BenchResult* res) {
+  for (int c = 0; bench_perf.enabled && c < PERF_NCOUNTERS; c++) {
+    int valid = (res->counters[c] >= 0);
+    if (format == BENCH_CSV) {
+      if (valid) (void) printf(",%.0lf", res->counters[c]);
+      else (void) printf(",");
+    } else if (format == BENCH_JSON) {
+      if (valid) (void) printf(", \"%s\": %.0lf", perf_names[c], res->counters[c]);
+      else (void) printf(", \"%s\": null", perf_names[c]);
+    } else {
+      if (valid) (void) printf(" %13.0lf |", res->counters[c]);
+      else (void) printf(" %13s |", "-");
+    }
+  }
+}
+
+static void
+bench_print_row(int format, const BenchResult* res, int first) {
+  /* 0 (or "-" in the table) for the O(log n) searches, len bytes were never read */
+  double gbps = (res->median_ms > 0 && !res->sublinear) ? res->len * sizeof(int) / (res->median_ms * 1e6) : 0;
+  int ok = (res->missing == res->expected);
+
+  if (format == BENCH_CSV) {
+    (void) printf("%s,%zu,%d,%d,%d,%d,%.6lf,%.6lf,%.6lf,%.3lf,%.3lf", res->name, res->len, res->nthreads, res->runs,
+                  res->missing, ok, res->min_ms, res->median_ms, res->p99_ms, gbps, res->speedup);
+    bench_print_counters(format, res);
+    (void) puts("");
+  } else if (format == BENCH_JSON) {
+    (void) printf("%s  {\"algorithm\": \"%s\", \"n\": %zu, \"threads\": %d, \"runs\": %d, \"missing\": %d, \"ok\": %s, "
+                  "\"min_ms\": %.6lf, \"median_ms\": %.6lf, \"p99_ms\": %.6lf, \"gbps\": %.3lf, \"speedup\": %.3lf",
+                  first ? "" : ",\n", res->name, res->len, res->nthreads, res->runs, res->missing, ok ? "true" : "false",
+                  res->min_ms, res->median_ms, res->p99_ms, gbps, res->speedup);
+    bench_print_counters(format, res);
+    (void) printf("}");
+  } else {
+    (void) printf("| %-11s | %9zu | %7d | %7d | %2s | %8.3lf | %11.3lf | %8.3lf |", res->name, res->len,
+                  res->nthreads, res->missing, ok ? "ok" : "NO", res->min_ms, res->median_ms, res->p99_ms);
+    if (res->sublinear) (void) printf(" %7s |", "-");
+    else (void) printf(" %7.3lf |", gbps);
+    (void) printf(" %6.2lfx |", res->speedup);
+    bench_print_counters(format, res);
+    (void) puts("");
+  }
+}
+
+static void
+bench_print_footer(int format) {
+  if (format == BENCH_JSON) (void) puts("\n]");
+}
+
+/* "1,2,4" -> {1, 2, 4}, returns the count or -1 if something isn't a positive number */
+static int
+bench_parse_list(const char* arg, long* out, int max) {
+  int count = 0;
+  char* end;
+  while (*arg && count < max) {
+    out[count] = strtol(arg, &end, 10);
+    if (end == arg || out[count] < 1 || (*end != ',' && *end != '\0')) return -1;
+    count++;
+    arg = (*end == ',') ? end + 1 : end;
+  }
+  return (*arg == '\0') ? count : -1;
+}
+
+/* Marks the picked algorithms, returns FALSE on an unknown name */
+static int
+bench_parse_algos(const char* arg, int* selected) {
+  char* list = strdup(arg);
+  int valid = (list != NULL);
+
+  for (char* name = strtok(list, ","); valid && name != NULL; name = strtok(NULL, ",")) {
+    int found = FALSE;
+    for (int a = 0; a < BENCH_NALGOS; a++) {
+      if (strcmp(name, bench_algos[a].name) == 0) {
+        selected[a] = found = TRUE;
+      }
+    }
+    valid = found;
+  }
+
+  free(list);
+  return valid;
+}
+
+static void
+bench_usage(void) {
+  (void) printf("aed-prj1 [-a algorithms] [-n sizes] [-t threads] [-r runs] [-w warmups] [-o table|csv|json]\n"
+                "         [-s radix|qsort] [-S seed] [-g generator threads] [-p] [-f int32 dump]\n"
+                "  lists are comma separated, threads 1-%d, algorithms:", MAX_THREADS);
+  for (int a = 0; a < BENCH_NALGOS; a++) (void) printf(" %s", bench_algos[a].name);
+  (void) printf("\n  naive and rescan only run above n = %d when picked with -a\n", NAIVE_MAX_LEN);
+  (void) printf("  -p adds perf_event_open hardware counters per run when the kernel allows it\n");
+}
+
+int
+main(int argc, char* argv[]) {
+
+  long sizes[BENCH_MAX_LIST] = {BENCH_DEFAULT_LEN};
+  long threads[BENCH_MAX_LIST] = {1};
+  int nsizes = 1, nthread_counts = 1;
+  int runs = BENCH_DEFAULT_RUNS, warmup = BENCH_DEFAULT_WARMUP;
+  int format = BENCH_TABLE;
+  int selected[BENCH_NALGOS] = {0};
+  int explicit_algos = FALSE;
+  const char* input_path = NULL;
+  uint64_t seed = time(NULL);
+  int gen_threads = 0;
+  int use_perf = FALSE;
+  int valid = TRUE;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "a:n:t:r:w:o:s:S:g:pf:")) != -1) {
+    switch (opt) {
+      case 'a': valid &= bench_parse_algos(optarg, selected); explicit_algos = TRUE; break;
+      case 'n': valid &= (nsizes = bench_parse_list(optarg, sizes, BENCH_MAX_LIST)) > 0; break;
+      case 't': valid &= (nthread_counts = bench_parse_list(optarg, threads, BENCH_MAX_LIST)) > 0; break;
+      case 'r': valid &= (runs = atoi(optarg)) > 0; break;
+      case 'w': valid &= (warmup = atoi(optarg)) >= 0; break;
+      case 'o':
+        if (strcmp(optarg, "table") == 0) format = BENCH_TABLE;
+        else if (strcmp(optarg, "csv") == 0) format = BENCH_CSV;
+        else if (strcmp(optarg, "json") == 0) format = BENCH_JSON;
+        else valid = FALSE;
+        break;
+      case 's':
+        if (strcmp(optarg, "radix") == 0) range_sort_kind = RANGE_SORT_RADIX;
+        else if (strcmp(optarg, "qsort") == 0) range_sort_kind = RANGE_SORT_QSORT;
+        else valid = FALSE;
+        break;
+      case 'S': seed = strtoull(optarg, NULL, 10); break;
+      case 'g': valid &= (gen_threads = atoi(optarg)) > 0 && gen_threads <= MAX_THREADS; break;
+      case 'p': use_perf = TRUE; break;
+      case 'f': input_path = optarg; break;
+      default: valid = FALSE; break;
+    }
+  }
+  for (int t = 0; valid && t < nthread_counts; t++) {
+    valid = (threads[t] <= MAX_THREADS);
+  }
+  if (!valid || optind != argc) {
+    bench_usage();
+    exit(EXIT_FAILURE);
+  }
+  if (!explicit_algos) {
+    for (int a = 0; a < BENCH_NALGOS; a++) selected[a] = TRUE;
+  }
+
+  const char* kernel = range_stats_dispatch();
+
+  /* The generator uses as many threads as the biggest -t value unless told otherwise */
+  if (gen_threads == 0) {
+    for (int t = 0; t < nthread_counts; t++) {
+      if (threads[t] > gen_threads) gen_threads = threads[t];
+    }
+  }
+  RangeGen gen;
+  range_gen_init(&gen, seed, gen_threads);
+
+  if (use_perf) perf_open(&bench_perf);
+
+  /* Settings go to stderr when stdout is meant for a CSV/JSON file */
+  FILE* info = (format == BENCH_TABLE) ? stdout : stderr;
+  (void) fprintf(info, "Checksum Kernel: %s\nSort: %s\nRuns: %d (+%d warmup)\nSeed: %llu\n", kernel,
+                 (range_sort_kind == RANGE_SORT_RADIX) ? "LSD radix" : "qsort", runs, warmup, (unsigned long long) seed);
+  if (use_perf) (void) fprintf(info, "Hardware Counters: %s\n", bench_perf.enabled ? "on" : "unavailable");
+
+  double* samples = malloc(runs * sizeof(*samples));
+  if (samples == NULL) {
+    perror("Failed to allocate samples.");
+    exit(EXIT_FAILURE);
+  }
 
+  BenchResult res;
+  int first = TRUE;
+  bench_print_header(format);
+
+  /* Only the checksum finder runs over the file */
+  if (input_path != NULL) {
+    for (int t = 0; t < nthread_counts; t++) {
+      uint64_t bytes = 0;
+      memset(bench_perf.value, 0, sizeof(bench_perf.value));
+      for (int r = -warmup; r < runs; r++) {
+        if (r >= 0 && bench_perf.enabled) perf_start(&bench_perf);
+        uint64_t t0 = wall_ns();
+        res.missing = range_check_missing_file(input_path, threads[t], &bytes);
+        uint64_t t1 = wall_ns();
+        if (r >= 0 && bench_perf.enabled) perf_stop(&bench_perf);
+        if (r >= 0) samples[r] = (t1 - t0) / 1e6;
+      }
+      bench_counters(&res, runs);
+      res.name = "file";
+      res.len = bytes / sizeof(int32_t);
+      res.nthreads = threads[t];
+      res.expected = res.missing;
+      bench_summarize(samples, runs, &res);
+      res.speedup = 1;
+      bench_print_row(format, &res, first);
+      first = FALSE;
+    }
+    bench_print_footer(format);
+    perf_close(&bench_perf);
+    free(samples);
+    return 0;
+  }
+
+  long max_len = 0;
+  for (int s = 0; s < nsizes; s++) {
+    if (sizes[s] > max_len) max_len = sizes[s];
+  }
+
+  int* input = malloc(max_len * sizeof(int));
+  int* input_sorted = malloc(max_len * sizeof(int));
+  int* seq = malloc(max_len * sizeof(int));
+  if (input == NULL || input_sorted == NULL || seq == NULL) {
+    perror("Failed to allocate sequences.");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int s = 0; s < nsizes; s++) {
+    size_t len = sizes[s];
+    if (len < 3) continue;
+
+    /* Same input for every algorithm at this size */
+    uint64_t t0 = wall_ns();
+    range_gen_fill(&gen, input, len, range_gen_int(&gen, -1000, 1000));
+    (void) fprintf(info, "Generated n = %zu in %.3lf ms (%d threads)\n", len, (wall_ns() - t0) / 1e6, gen.nthreads);
+    memcpy(input_sorted, input, len * sizeof(int));
+    range_sort(input_sorted, len);
+    res.expected = range_check_missing_checksum(input, len);
+
+    for (int a = 0; a < BENCH_NALGOS; a++) {
+      const BenchAlgo* algo = &bench_algos[a];
+      if (!selected[a]) continue;
+      if (algo->quadratic && len > NAIVE_MAX_LEN && !explicit_algos) continue;
+
+      const int* src = (algo->input == BENCH_INPUT_SORTED) ? input_sorted : input;
+      double base_median = 0;
+
+      for (int t = 0; t < nthread_counts; t++) {
+        if (!algo->threaded && t > 0) break;
+
+        int nthreads = algo->threaded ? threads[t] : 1;
+        bench_run(algo, src, seq, len, nthreads, warmup, runs, samples, &res);
+
+        if (t == 0) base_median = res.median_ms;
+        res.speedup = (res.median_ms > 0) ? base_median / res.median_ms : 1;
+        bench_print_row(format, &res, first);
+        first = FALSE;
+      }
+    }
+  }
+  bench_print_footer(format);
+
+  free(input);
+  free(input_sorted);
+  free(seq);
+  free(samples);
+  perf_close(&bench_perf);
+  return 0;
+}
+
+void
+print_arr(int* arr, int len) {
+  for (int* ptr = arr; ptr != arr+len; ptr++) {
+    printf("%d ", *ptr);
+  }
+  putc('\n', stdout);
 }
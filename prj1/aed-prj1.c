@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <time.h>
 #include <limits.h>
@@ -32,6 +33,24 @@ int range_check_missing_naive(int* seq, size_t len);
 int range_check_missing_sort(int* seq, size_t len);
 int range_check_missing_checksum(int* seq, size_t len);
 
+/* LSD radix with 11-bit digits by default, quick_sort for tiny inputs
+ * or when the scratch buffer can't be allocated */
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES ((32 + RADIX_BITS - 1) / RADIX_BITS)
+#define RADIX_MIN_LEN 64
+
+void range_radix_sort(int* seq, size_t len, int* tmp);
+void range_sort(int* seq, size_t len);
+int range_sort_gap_scan(const int* seq, size_t len);
+
+/* Already sorted input: sampled sortedness check, then O(log n) searches */
+#define PRESORTED_SAMPLES 64
+
+int range_is_sorted_sampled(const int* seq, size_t len);
+int range_check_missing_presorted(int* seq, size_t len);
+int range_check_missing_gallop(const int* seq, size_t len, size_t* checked);
+
 int
 range_check_missing_naive(int* seq, size_t len) {
 
@@ -68,14 +87,134 @@ range_check_missing_naive(int* seq, size_t len) {
 int
 range_check_missing_sort(int* seq, size_t len) {
 
-  quick_sort(seq, 0, len);
+  range_sort(seq, len);
+  return range_sort_gap_scan(seq, len);
+}
 
-  for (int* ptr_end = seq + len - 1; seq != ptr_end; seq++) {
+int
+range_sort_gap_scan(const int* seq, size_t len) {
+  for (const int* ptr_end = seq + len - 1; seq != ptr_end; seq++) {
     if (*(seq+1) != *seq + 1) return *seq + 1;
   }
   return TRUE;
 }
 
+/* Cheap guess, not a proof: the span must fit one gap at most and
+ * PRESORTED_SAMPLES evenly spaced neighbours must be in order */
+int
+range_is_sorted_sampled(const int* seq, size_t len) {
+  if (len < 2) return TRUE;
+
+  int64_t span = (int64_t) seq[len-1] - seq[0];
+  if (span != (int64_t) len - 1 && span != (int64_t) len) return FALSE;
+
+  size_t step = (len - 1) / PRESORTED_SAMPLES + 1;
+  for (size_t i = 0; i + 1 < len; i += step) {
+    if (seq[i+1] <= seq[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+/* First index where seq[i] != seq[0] + i, everything before it is gap-free */
+static size_t
+_range_first_gap(const int* seq, size_t lo, size_t hi) {
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((int64_t) seq[mid] == (int64_t) seq[0] + (int64_t) mid) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int
+range_check_missing_presorted(int* seq, size_t len) {
+
+  if (!range_is_sorted_sampled(seq, len)) return range_check_missing_sort(seq, len);
+
+  size_t i = _range_first_gap(seq, 0, len);
+  if (i == len) return TRUE;
+  return seq[0] + (int) i;
+}
+
+/* For sorted streams that grow by appending blocks: *checked is a prefix
+ * already known to be gap-free. Gallop 1, 2, 4, ... past it and binary search
+ * the last step, so the cost is O(log distance to the gap). */
+int
+range_check_missing_gallop(const int* seq, size_t len, size_t* checked) {
+
+  size_t lo = (*checked < len) ? *checked : len;
+  size_t step = 1;
+
+  while (lo + step < len && (int64_t) seq[lo + step] == (int64_t) seq[0] + (int64_t) (lo + step)) {
+    lo += step;
+    step <<= 1;
+  }
+
+  size_t hi = (lo + step < len) ? lo + step : len;
+  size_t i = _range_first_gap(seq, lo, hi);
+
+  *checked = i;
+  if (i == len) return TRUE;
+  return seq[0] + (int) i;
+}
+
+/* Sign bit flipped so negative keys come first, one histogram pass for all
+ * digits, and passes where every key shares the digit are skipped */
+void
+range_radix_sort(int* seq, size_t len, int* tmp) {
+
+  size_t hist[RADIX_PASSES][RADIX_BUCKETS];
+  memset(hist, 0, sizeof(hist));
+
+  for (const int *ptr = seq, *end_ptr = seq + len; ptr != end_ptr; ptr++) {
+    uint32_t u = (uint32_t) *ptr ^ 0x80000000u;
+    for (int p = 0; p < RADIX_PASSES; p++) {
+      hist[p][(u >> (p*RADIX_BITS)) & (RADIX_BUCKETS-1)]++;
+    }
+  }
+
+  int* src = seq;
+  int* dst = tmp;
+  for (int p = 0; p < RADIX_PASSES; p++) {
+    int shift = p*RADIX_BITS;
+    size_t* count = hist[p];
+
+    if (count[(((uint32_t) src[0] ^ 0x80000000u) >> shift) & (RADIX_BUCKETS-1)] == len) continue;
+
+    size_t offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+
+    for (const int *ptr = src, *end_ptr = src + len; ptr != end_ptr; ptr++) {
+      uint32_t digit = (((uint32_t) *ptr ^ 0x80000000u) >> shift) & (RADIX_BUCKETS-1);
+      dst[count[digit]++] = *ptr;
+    }
+
+    int* swap_ptr = src;
+    src = dst;
+    dst = swap_ptr;
+  }
+
+  if (src != seq) memcpy(seq, src, len * sizeof(*seq));
+}
+
+void
+range_sort(int* seq, size_t len) {
+
+  int* tmp = (len >= RADIX_MIN_LEN) ? malloc(len * sizeof(*seq)) : NULL;
+
+  if (tmp == NULL) {
+    quick_sort(seq, 0, (int) len - 1);
+    return;
+  }
+
+  range_radix_sort(seq, len, tmp);
+  free(tmp);
+}
+
 int
 range_check_missing_checksum(int* seq, size_t len) {
 
@@ -102,9 +241,12 @@ range_check_missing_checksum(int* seq, size_t len) {
 
 #define AVERAGE 10
 
-clock_t start, end;
-int missing_sorted = 0;
-double time_sorted = 0;
+clock_t start, mid, end;
+int missing_sorted = 0, missing_sum = 0, missing_naive = 0;
+int missing_presorted = 0, missing_gallop = 0;
+double time_sorted = 0, time_naive = 0, time_sum = 0;
+double time_sort_phase = 0, time_scan_phase = 0;
+double time_presorted = 0, time_gallop = 0;
 
 int
 main() {
@@ -114,38 +256,76 @@ main() {
 
   (void) printf("Array Size: %d\nIterations per Algorithm: %d\n", NMAX, AVERAGE);
 
+  /* Heap buffer for the biggest size, a VLA of NMAX ints overflows the stack */
+  int* random_seq = (int*) malloc(sizeof(int) * NMAX);
+  if (random_seq == NULL) {
+    perror("Failed to allocate sequence.");
+    exit(EXIT_FAILURE);
+  }
+
+  (void) puts("n\tsorted\tsort\tscan\tpresorted\tgallop");
+
   for (int n = NSTART; n <= NMAX; n+= NSTEP) {
 
     missing_sorted = 0;
     time_sorted = 0;
+    time_sort_phase = 0;
+    time_scan_phase = 0;
+    time_presorted = 0;
+    time_gallop = 0;
 
     for (int i = 0; i < AVERAGE; i++) {
 
-      int random_seq[n];
       range_missing_fill(random_seq, n, RAND(-n, n) );
 
       start = clock();
-      missing_naive = range_check_missing_naive(random_seq, NMAX);
+      missing_naive = range_check_missing_naive(random_seq, n);
       end = clock();
       time_naive += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
 
       start = clock();
       missing_sum = range_check_missing_checksum(random_seq, n);
       end = clock();
+      time_sum += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
 
+      /* range_check_missing_sort, timed per phase */
+      start = clock();
+      range_sort(random_seq, n);
+      mid = clock();
+      missing_sorted = range_sort_gap_scan(random_seq, n);
+      end = clock();
       time_sorted += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+      time_sort_phase += ((double) (mid - start)*1000) / CLOCKS_PER_SEC;
+      time_scan_phase += ((double) (end - mid)*1000) / CLOCKS_PER_SEC;
 
+      /* The array is sorted now, same answer in O(log n) */
       start = clock();
-      missing_sorted = range_check_missing_sort(random_seq, n);
+      missing_presorted = range_check_missing_presorted(random_seq, n);
       end = clock();
-      time_sorted += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+      time_presorted += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+
+      /* Sorted stream that grows by NSTEP elements at a time */
+      size_t checked = 0;
+      start = clock();
+      for (int len = NSTEP; len <= n; len += NSTEP) {
+        missing_gallop = range_check_missing_gallop(random_seq, len, &checked);
+      }
+      end = clock();
+      time_gallop += ((double) (end - start)*1000) / CLOCKS_PER_SEC;
+
+      if (missing_presorted != missing_sorted || missing_gallop != missing_sorted) {
+        printf("Mismatch at n = %d: %d %d %d\n", n, missing_sorted, missing_presorted, missing_gallop);
+      }
 
       /*printf("| Algorithm | Missing | Avg. Time (ms) |\n| Naive     | %7d | %14.3lf |\n| Sorted    | %7d | %14.3lf |\n| Linear    | %7d | %14.3lf |\n", missing_naive, time_naive/i, missing_sorted, time_sorted/i, missing_sum, time_sum/i) ;*/
     }
-    printf("%d\t%.4lf\n", n, time_sorted / AVERAGE);
+    printf("%d\t%.4lf\t%.4lf\t%.4lf\t%.4lf\t%.4lf\n", n, time_sorted / AVERAGE, time_sort_phase / AVERAGE, time_scan_phase / AVERAGE,
+           time_presorted / AVERAGE, time_gallop / AVERAGE);
 
   }
 
+  free(random_seq);
+
 }
 
 int
@@ -1,4 +1,5 @@
 /* Código feito para C99, compilado com GCC 14.2.1 com flags --std=c99 -O2 e --fast-math
+ * (make perf junta -DPERF para os contadores de hardware via perf_event_open)
  *
  * Hardware Original: TOSHIBA SATELLITE_C50-A PSCG6P-01YAR1, 
  * CPU: Intel i5-3320M (4) @ 3.300GHz,
@@ -8,13 +9,32 @@
  * Aluno: Vasco Alves, 2022228207
 */
 
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
 #include <assert.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BTREE_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(PERF) && defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 #define RESIZE_FACTOR 1.61803
+#define BINARY_HASH_MUL 0x9E3779B1u // hashing de Fibonacci, os bits altos do produto dão o slot
 
 #define IDX_INVALID 4294967295
 
@@ -23,6 +43,44 @@
 #define BLACK 0
 #define RED 1
 
+/* Profundidade máxima das pilhas de caminho das inserções iterativas.
+ * AVL (< 1.45 log2 n) e RB (< 2 log2 n) nunca lá chegam com índices de 32 bits,
+ * a Treap volta à inserção recursiva se passar disto */
+#define TREE_MAX_DEPTH 128
+
+/* Com -DTREE_ORDER_STATS (make stats) os nós da AVL, RB e Treap guardam o
+ * tamanho da subárvore e há rank/select em O(log n). Sem a flag o campo não
+ * existe e as funções _*_update_size ficam vazias */
+
+/* Snapshots (um escritor, vários leitores): o arena é feito de blocos de
+ * 2^SNAP_CHUNK_BITS nós que nunca mudam de sítio, o diretório tem tamanho fixo */
+#define SNAP_CHUNK_BITS 16
+#define SNAP_MAX_CHUNKS 65536
+#define SNAP_MAX_READERS 64
+#define SNAP_RECLAIM_BATCH 4096 // nós retirados antes de tentar reciclar
+#define SNAP_READER_LOOKUPS (1 << 18)
+
+/* Skip list lock-free: torres até SKIP_MAX_LEVEL, p = 1/2 por nível */
+#define SKIP_MAX_LEVEL 24
+#define SKIP_MAX_THREADS 64
+
+/* Operações de conjuntos da Treap (split/merge). Acima de TREAP_SET_GRAIN chaves
+ * (estimadas) os dois lados da recursão correm em paralelo no fork-join pool */
+#define TREAP_SET_UNION 0
+#define TREAP_SET_INTERSECT 1
+#define TREAP_SET_DIFFERENCE 2
+#define TREAP_SET_GRAIN 65536
+#define FORKJOIN_MAX_PENDING 1024 // com a pilha cheia o fork corre a tarefa logo
+
+/* Pesquisas em lote: quantas descidas andam ao mesmo tempo. Cada uma pede o
+ * próximo nó com prefetch e só lhe toca na volta seguinte, quando já chegou */
+#define SEARCH_GROUP 16
+
+/* B+ tree: nós de 128 bytes (duas linhas de cache) */
+#define BTREE_INNER_KEYS 15
+#define BTREE_LEAF_KEYS 30
+#define BTREE_MAX_HEIGHT 16
+
 typedef uint32_t idx_t;
 typedef int32_t key_t;
 
@@ -40,59 +98,316 @@ typedef struct BinaryTree {
     uint32_t capacity; 
     uint32_t elements;
     BinTreeNode *root; 
+    idx_t *hash;        // índice dos nós por chave (opcional), NULL se desligado
+    uint32_t hash_bits; // a tabela tem 1<<hash_bits slots
 } BinTree ;
 
+/* Mesma árvore implícita com cada campo no seu array: a pesquisa só lê as
+ * chaves, 4 bytes por nó em vez dos 12 de BinTreeNode */
+typedef struct BinTreeSoA {
+    uint32_t capacity;
+    uint32_t elements;
+    key_t *keys;       // alinhado a 64 bytes para loads AVX2 alinhados
+    idx_t *idx_left;
+    idx_t *idx_right;
+} BinTreeSoA;
+
+/* Modo implícito: os filhos de i são 2i e 2i+1 (a raiz só tem o 1, à direita),
+ * exatamente os índices que tree_binary_insert escreve, por isso nem se guardam.
+ * 0 continua a ser "sem filho" */
+typedef struct BinTreeImplicit {
+    uint32_t capacity;
+    uint32_t elements;
+    key_t *keys;       // alinhado a 64 bytes, partilha a pesquisa da SoA
+} BinTreeImplicit;
+
 typedef struct AVLNode {
     idx_t left;
     idx_t right;
     int key;
     int height;
+#ifdef TREE_ORDER_STATS
+    idx_t size;     // nós da subárvore, incluindo este
+#endif
 } AVLNode;
 
 typedef struct AVLTree {
     AVLNode *nodes;
     idx_t tree_root; // rotations cause the root to change
-    idx_t elements;
+    idx_t elements;  // slots usados, vivos e livres
     idx_t capacity;
-} AVLTree; // 20 bytes
+    idx_t free_head; // slots apagados ligados pelo campo left, IDX_INVALID se não houver
+} AVLTree; // 24 bytes
 
 typedef struct RBNode {
     idx_t left;     // 4 bytes
     idx_t right;    // 4 bytes
     key_t key;      // 4 bytes
     int8_t color;   // 1 bytes
+#ifdef TREE_ORDER_STATS
+    idx_t size;     // 4 bytes
+#endif
 } RBNode;
 
 typedef struct RBTree {
     RBNode *nodes;
     idx_t tree_root;
-    idx_t elements;
+    idx_t elements;  // slots usados, vivos e livres
     idx_t capacity;
+    idx_t free_head; // lista de slots livres pelo campo left
 } RBTree;
 
+/* Layouts compactos (12 bytes por nó): o equilíbrio da AVL (-1, 0, +1 guardado
+ * como 0..2) vive nos 2 bits de cima do índice esquerdo, a cor da RB no bit de
+ * cima. O resto do campo é o índice, todo a 1 quer dizer IDX_INVALID */
+#define AVL_PACKED_IDX_MASK 0x3FFFFFFFu
+#define RB_PACKED_IDX_MASK  0x7FFFFFFFu
+
+typedef struct AVLPackedNode {
+    idx_t left_balance; // 2 bits equilíbrio + 30 bits índice
+    idx_t right;
+    key_t key;
+} AVLPackedNode; // 12 bytes
+
+typedef struct AVLPackedTree {
+    AVLPackedNode *nodes;
+    idx_t tree_root;
+    idx_t elements;
+    idx_t capacity;
+} AVLPackedTree;
+
+typedef struct RBPackedNode {
+    idx_t left_color;   // 1 bit cor + 31 bits índice
+    idx_t right;
+    key_t key;
+} RBPackedNode; // 12 bytes
+
+typedef struct RBPackedTree {
+    RBPackedNode *nodes;
+    idx_t tree_root;
+    idx_t elements;
+    idx_t capacity;
+} RBPackedTree;
+
 typedef struct TreapNode {
     key_t key;
     idx_t priority;
     idx_t left;
     idx_t right;
+#ifdef TREE_ORDER_STATS
+    idx_t size;
+#endif
 } TreapNode;
 
 typedef struct Treap {
     TreapNode* nodes;
     idx_t tree_root;
-    idx_t elements;
+    idx_t elements;  // slots usados, vivos e livres
     idx_t capacity;
+    idx_t free_head; // lista de slots livres pelo campo left
 } Treap;
 
+/* Cursor em ordem sobre qualquer um dos arenas (AVL, RB, Treap), sem alocar:
+ * guarda o caminho desde a raiz, path[depth-1] == current. Os campos são lidos
+ * pelos offsets, como em _arena_preorder. Se o caminho não couber em
+ * TREE_MAX_DEPTH (só numa Treap muito azarada) fica overflow e cada passo
+ * volta a descer da raiz. Inserir ou apagar invalida o cursor */
+typedef struct TreeCursor {
+    const char *nodes;
+    size_t stride;
+    size_t key_offset;
+    size_t left_offset;
+    size_t right_offset;
+    idx_t root;
+    idx_t current;     // IDX_INVALID quando está fora da árvore
+    int depth;
+    int overflow;
+    idx_t path[TREE_MAX_DEPTH];
+} TreeCursor;
+
+/* AVL persistente por cópia do caminho: o escritor nunca altera um nó que um
+ * leitor possa ver, copia o caminho até à raiz e publica a raiz nova. Os nós
+ * antigos ficam retirados com a época em que saíram e só voltam à lista livre
+ * quando nenhum leitor anunciou uma época <= essa (epoch-based reclamation) */
+typedef struct SnapNode {
+    idx_t left;
+    idx_t right;
+    key_t key;
+    int height;
+} SnapNode;
+
+typedef struct SnapReader {
+    uint64_t epoch;     // 0 fora de uma leitura, senão a época em que entrou
+    char pad[56];       // um leitor por linha de cache
+} SnapReader;
+
+typedef struct SnapRetired {
+    idx_t node;
+    uint64_t epoch;
+} SnapRetired;
+
+typedef struct SnapTree {
+    SnapNode **chunks;          // SNAP_MAX_CHUNKS ponteiros, alocados por ordem
+    SnapReader *readers;        // SNAP_MAX_READERS, alinhado a 64 bytes
+    idx_t root;                 // raiz publicada, atómica
+    idx_t elements;
+    idx_t next_slot;            // primeiro slot nunca usado
+    idx_t free_head;            // slots reciclados ligados por left
+    uint64_t epoch;             // época global, atómica, começa em 1
+    SnapRetired *retired;       // só o escritor mexe, por ordem de época
+    size_t retired_count;
+    size_t retired_capacity;
+} SnapTree;
+
+typedef struct SnapReaderArgs {
+    SnapTree *tree;
+    const key_t *keys;
+    size_t n;
+    int reader;
+    size_t hits;
+    double seconds;     // tempo de parede só das pesquisas deste leitor
+} SnapReaderArgs;
+
+/* Nó da skip list dentro do arena de idx_t: as torres têm tamanhos diferentes,
+ * cada nó ocupa 2 + level palavras a partir do seu offset */
+typedef struct SkipNode {
+    key_t key;
+    idx_t level;
+    idx_t next[];       // offset do seguinte em cada nível, IDX_INVALID no fim
+} SkipNode;
+
+/* Só inserções: sem remoções não há nós marcados nem memória a recuperar.
+ * O arena é reservado de uma vez (um realloc mudaria os nós debaixo das outras
+ * threads) e cada inserção tira a sua torre com um fetch_add */
+typedef struct SkipList {
+    idx_t *words;
+    idx_t capacity;     // em palavras
+    idx_t used;         // atómico
+    idx_t head;         // torre sentinela com SKIP_MAX_LEVEL níveis
+    idx_t elements;     // atómico
+} SkipList;
+
+typedef struct SkipWriterArgs {
+    SkipList *list;
+    const key_t *keys;
+    size_t begin;
+    size_t end;
+    idx_t rng;          // estado xorshift próprio, rng_state não é thread-safe
+} SkipWriterArgs;
+
+/* Quem faz fork continua com o outro lado e depois faz join; enquanto a tarefa
+ * não acaba, o join vai executando tarefas pendentes (a sua ou de outros) */
+typedef struct ForkJoinTask {
+    void (*run)(void *arg);
+    void *arg;
+    int done;           // atómico
+} ForkJoinTask;
+
+/* Tem mutex e threads a apontar para ele, por isso vive no heap e não se copia */
+typedef struct ForkJoinPool {
+    pthread_t *threads;
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    ForkJoinTask *pending[FORKJOIN_MAX_PENDING]; // pilha LIFO de tarefas por começar
+    int top;
+    int stop;
+} ForkJoinPool;
+
+typedef struct TreapSetTask {
+    ForkJoinTask task;
+    Treap *treap;
+    ForkJoinPool *pool;
+    int op;
+    idx_t a;
+    idx_t b;
+    size_t estimate;    // chaves esperadas nas duas subárvores
+    idx_t result;
+} TreapSetTask;
+
+/* Nó interior: child[i] tem as chaves em [keys[i-1], keys[i]).
+ * keys e count ocupam 16 lanes seguidas para a pesquisa em SIMD */
+typedef struct BTreeInner {
+    key_t keys[BTREE_INNER_KEYS];
+    idx_t count;                        // número de chaves, count+1 filhos
+    idx_t child[BTREE_INNER_KEYS + 1];
+} BTreeInner; // 128 bytes
+
+typedef struct BTreeLeaf {
+    key_t keys[BTREE_LEAF_KEYS];
+    idx_t count;
+    idx_t next;                         // folha seguinte por ordem, IDX_INVALID na última
+} BTreeLeaf; // 128 bytes
+
+/* Dois arenas, um por tipo de nó. Com height == 0 a raiz é uma folha */
+typedef struct BTree {
+    BTreeInner *inner;
+    BTreeLeaf *leaves;
+    idx_t tree_root;
+    int height;
+    idx_t elements;                     // chaves
+    idx_t inner_elements;
+    idx_t inner_capacity;
+    idx_t leaf_elements;
+    idx_t leaf_capacity;
+} BTree;
+
+/* Árvores congeladas: só leitura, sem índices, chaves únicas numa ordem
+ * que segue o caminho das pesquisas. Eytzinger guarda por níveis (BFS) a partir
+ * de 1, o filho de i está em 2i e 2i+1 */
+typedef struct EytzTree {
+    key_t *keys;    // keys[0] não é usado
+    idx_t elements;
+} EytzTree;
+
+/* van Emde Boas: a árvore perfeita de altura h divide-se numa de cima com
+ * h - h/2 níveis e nas de baixo com h/2 níveis, guardadas seguidas, e assim
+ * recursivamente. Para cada profundidade d basta saber onde começa a árvore de
+ * cima a que pertence o pai e o tamanho das duas partes */
+typedef struct VebLevel {
+    idx_t top_size;     // nós da árvore de cima
+    idx_t bottom_size;  // nós de cada árvore de baixo (a que começa em d)
+    int top_depth;      // profundidade da raiz da árvore de cima
+} VebLevel;
+
+typedef struct VebTree {
+    key_t *keys;        // 2^height - 1 posições, o fim é preenchido com a maior chave
+    idx_t elements;
+    int height;
+    VebLevel level[32];
+} VebTree;
+
+/* Contadores de hardware (make perf), lidos à volta de cada região medida */
+#define PERF_NCOUNTERS 5
+
+typedef struct PerfCounters {
+    int enabled;                    // pelo menos um contador aberto
+    int fd[PERF_NCOUNTERS];         // -1 se não estiver disponível
+    uint64_t value[PERF_NCOUNTERS]; // acumulado entre perf_start/perf_stop
+} PerfCounters;
+
+static PerfCounters g_perf = {0, {-1, -1, -1, -1, -1}, {0}};
+
 /* === HELPER FUNCTIONS === */
 static inline int randint(int a, int b);
 static inline idx_t rand_idx(idx_t a, idx_t b);
+static inline idx_t xorshift_next(idx_t *state); // o passo de rand_idx sobre um estado qualquer
 static inline int max(int a, int b);
 static key_t*   arr_gen_conj_a(const key_t size); // ordem crescent, pouca repetição
 static key_t*   arr_gen_conj_b(const key_t size); // ordem decrescent, pouca repetição
 static key_t*   arr_gen_conj_c(const key_t size); // ordem aleatoria, pouca repetição
 static key_t*   arr_gen_conj_d(const key_t size); // ordem aleatoria, 90% repetidos
 static void     arr_print(key_t* arr, key_t size);
+static int      arr_sorted_order(const key_t* arr, size_t size); // 1 crescente, -1 decrescente, 0 sem ordem
+static size_t   arr_unique_sorted(const key_t* arr, size_t size, key_t* out, size_t stride); // chaves únicas crescentes
+
+/* ===== PERF COUNTERS ===== */
+static void     perf_open(PerfCounters *perf);
+static void     perf_close(PerfCounters *perf);
+static void     perf_clear(PerfCounters *perf);
+static void     perf_start(PerfCounters *perf);
+static void     perf_stop(PerfCounters *perf);
+static void     perf_log(FILE *fptr, PerfCounters *perf, int iterations); // acaba a linha do log
 
 /* ===== BINARY TREE ===== */
 extern BinTree  tree_binary_create(uint32_t initial_capacity); // Creates binary tree with inicialized elements
@@ -104,7 +419,43 @@ extern void     tree_binary_print_inorder(BinTree *btree); // in order print acc
 extern void     tree_binary_print(BinTree *btree);  // print by levels for visual accuracy
 extern idx_t    tree_binary_search_key_inorder(BinTree btree, int32_t key); // search for key in binary tree by order
 extern idx_t    tree_binary_search_key_level(BinTree btree, int32_t key); // faster than inorder because of this structure
+extern int      tree_binary_delete(BinTree *btree, key_t key); // o último nó ocupa o lugar do apagado
+extern void     tree_binary_hash_enable(BinTree *btree); // liga o índice de hash, as inserções deixam de percorrer o array
+static void     _binary_hash_rebuild(BinTree *btree, uint32_t min_slots); // potência de 2 >= 2*min_slots
+static idx_t*   _binary_hash_slot(const BinTree *btree, key_t key); // slot da chave ou o vazio onde ficaria
+static void     _binary_hash_erase(BinTree *btree, idx_t *slot); // remoção com backward shift
+extern void     tree_binary_compact(BinTree *btree); // só encolhe a capacidade, a árvore é sempre contígua
 extern void     binary_test_and_log(key_t* arr, FILE *fptr);
+extern BinTreeSoA tree_binary_soa_create(uint32_t initial_capacity);
+extern BinTreeSoA tree_binary_soa_from(const BinTree *btree); // copia uma BinTree já construída
+extern void     tree_binary_soa_destroy(BinTreeSoA tree);
+extern void     tree_binary_soa_resize(BinTreeSoA *tree);
+extern void     tree_binary_soa_insert(BinTreeSoA *tree, key_t key); // NO DUPLICATES
+extern void     tree_binary_soa_insert_arr(BinTreeSoA *tree, key_t* arr, key_t size);
+extern idx_t    tree_binary_soa_search(const BinTreeSoA *tree, key_t key); // índice do nó ou IDX_INVALID
+static idx_t    _binary_keys_find(const key_t *keys, idx_t elements, key_t key); // AVX2 quando existe
+static idx_t    _binary_keys_find_scalar(const key_t *keys, idx_t elements, key_t key);
+extern void     soa_test_and_log(key_t* arr, FILE *fptr); // GB/s da pesquisa linear, AoS contra SoA
+extern BinTreeImplicit tree_binary_implicit_create(uint32_t initial_capacity);
+extern void     tree_binary_implicit_destroy(BinTreeImplicit tree);
+extern void     tree_binary_implicit_resize(BinTreeImplicit *tree);
+extern void     tree_binary_implicit_insert(BinTreeImplicit *tree, key_t key); // NO DUPLICATES
+extern void     tree_binary_implicit_insert_arr(BinTreeImplicit *tree, key_t* arr, key_t size);
+extern void     tree_binary_implicit_print_inorder(BinTreeImplicit *tree);
+extern void     tree_binary_implicit_print(BinTreeImplicit *tree);
+extern idx_t    tree_binary_implicit_search_key_inorder(BinTreeImplicit tree, int32_t key);
+extern idx_t    tree_binary_implicit_search_key_level(BinTreeImplicit tree, int32_t key); // índice do nó
+extern void     implicit_test_and_log(key_t* arr, FILE *fptr); // memória e construção, com e sem índices
+extern void     bulk_test_and_log(key_t* arr, FILE *fptr); // AVL, RB e Treap construídas com *_build_sorted
+extern void     iter_test_and_log(key_t* arr, FILE *fptr); // AVL, RB e Treap com inserção iterativa
+extern void     search_test_and_log(key_t* arr, FILE *fptr); // pesquisa uma a uma contra *_search_batch
+extern void     freeze_test_and_log(key_t* arr, FILE *fptr); // AVL ligada contra Eytzinger e vEB
+extern void     delete_test_and_log(key_t* arr, FILE *fptr); // inserções e remoções com tamanho constante
+static idx_t    _arena_preorder(const char *nodes, size_t stride, size_t left_offset, size_t right_offset,
+                                idx_t root, idx_t slots, idx_t *order, idx_t *remap); // nova ordem para compact
+static inline void _arena_search_batch(const char *nodes, size_t stride, size_t key_offset, size_t left_offset,
+                                       size_t right_offset, idx_t root, const key_t *keys, size_t n,
+                                       idx_t *out_idx); // motor de tree_{avl,rb,treap}_search_batch
 
 /* ===== AVL TREE ===== */
 extern AVLTree tree_avl_create(idx_t inicial_capacity);
@@ -112,26 +463,49 @@ extern void    tree_avl_destroy(AVLTree* avl);
 extern void    tree_avl_resize(AVLTree *avl);
 static int      _avl_get_height(AVLTree* avl, idx_t index);
 static int      _avl_get_balance(AVLTree* avl, idx_t index);
+static void     _avl_update_size(AVLTree *avl, idx_t index); // sem TREE_ORDER_STATS não faz nada
 static idx_t    _avl_rotate_right(AVLTree *avl, idx_t y_index);
 static idx_t    _avl_rotate_left(AVLTree *avl, idx_t x_index);
 static idx_t    _avl_insert_recursive(AVLTree *avl, idx_t node_index, int key);
 extern void     tree_avl_insert(AVLTree *avl, int key);
+extern void     tree_avl_insert_iter(AVLTree *avl, key_t key); // sem recursão, pára quando a altura não muda
 extern void     tree_avl_insert_arr(AVLTree *avl, key_t* arr, size_t size);
 extern AVLNode* tree_avl_search(AVLTree *avl, int key);
+extern void     tree_avl_search_batch(AVLTree *avl, const key_t *keys, size_t n, idx_t *out_idx); // IDX_INVALID se não existir
 extern void     tree_avl_in_order(AVLTree *avl); // in-order print
+static idx_t    _avl_build_range(AVLNode *nodes, idx_t lo, idx_t hi);
+extern AVLTree  tree_avl_build_sorted(key_t* arr, size_t size); // O(n) para arrays ordenados, sem rotações
+static idx_t    _avl_node_alloc(AVLTree *avl); // tira da lista livre ou do fim do arena
+static idx_t    _avl_rebalance(AVLTree *avl, idx_t node_index);
+static idx_t    _avl_delete_recursive(AVLTree *avl, idx_t node_index, key_t key, idx_t *removed);
+extern int      tree_avl_delete(AVLTree *avl, key_t key); // 1 se a chave existia
+extern void     tree_avl_compact(AVLTree *avl); // renumera os nós vivos em pré-ordem e encolhe o arena
 
 /* ===== RED BLACK TREE ===== */
 extern RBTree  tree_rb_create(uint32_t initial_capacity);
 extern void    tree_rb_destroy(RBTree *rb);
 extern void    tree_rb_resize(RBTree *rb);
 static int     _rb_is_red(RBTree *tree, idx_t i);
+static void    _rb_update_size(RBTree *tree, idx_t i);
 static idx_t   _rb_rotate_left(RBTree *tree, idx_t h);
 static idx_t   _rb_rotate_right(RBTree *tree, idx_t h);
 static void    _rb_flip_colors(RBTree *tree, idx_t h);
 static idx_t   _rb_fix_up(RBTree *tree, idx_t h);
 static idx_t   _rb_insert_recursive(RBTree *tree, idx_t h, key_t key);
 extern void    tree_rb_insert(RBTree *tree, key_t key);
+static idx_t   _rb_fix_up_tracked(RBTree *tree, idx_t h, int *changed);
+extern void    tree_rb_insert_iter(RBTree *tree, key_t key);
 extern int     tree_rb_search(RBTree *rb, int key);
+extern void    tree_rb_search_batch(RBTree *tree, const key_t *keys, size_t n, idx_t *out_idx);
+static idx_t   _rb_build_range(RBNode *nodes, idx_t lo, idx_t hi, int black_height, uint64_t child_cap);
+extern RBTree  tree_rb_build_sorted(key_t* arr, size_t size);
+static idx_t   _rb_node_alloc(RBTree *tree);
+static idx_t   _rb_move_red_left(RBTree *tree, idx_t h);
+static idx_t   _rb_move_red_right(RBTree *tree, idx_t h);
+static idx_t   _rb_delete_min(RBTree *tree, idx_t h, idx_t *removed);
+static idx_t   _rb_delete_recursive(RBTree *tree, idx_t h, key_t key, idx_t *removed);
+extern int     tree_rb_delete(RBTree *tree, key_t key);
+extern void    tree_rb_compact(RBTree *tree);
 
 /* ===== TREAP ===== */ 
 extern Treap tree_treap_create(idx_t initial_capacity);
@@ -141,6 +515,158 @@ static idx_t _treap_rotate_right(Treap *treap, idx_t x_idx);
 static idx_t _treap_rotate_left(Treap *treap, idx_t x_idx);
 static idx_t _treap_insert_recursive(Treap *treap, idx_t idx, key_t key);
 extern void  tree_treap_insert(Treap *treap, key_t key);
+extern void  tree_treap_insert_iter(Treap *treap, key_t key);
+extern idx_t tree_treap_search(Treap *treap, key_t key);
+extern void  tree_treap_search_batch(Treap *treap, const key_t *keys, size_t n, idx_t *out_idx);
+extern Treap tree_treap_build_sorted(key_t* arr, size_t size);
+static idx_t _treap_node_alloc(Treap *treap);
+static void  _treap_update_size(Treap *treap, idx_t idx);
+static idx_t _treap_delete_recursive(Treap *treap, idx_t idx, key_t key, idx_t *removed);
+extern int   tree_treap_delete(Treap *treap, key_t key); // desce o nó com rotações até ser folha
+extern void  tree_treap_compact(Treap *treap);
+
+/* ===== PACKED AVL / RB ===== */
+static inline idx_t _avlp_left(const AVLPackedNode *node);
+static inline void  _avlp_set_left(AVLPackedNode *node, idx_t left);
+static inline int   _avlp_balance(const AVLPackedNode *node);
+static inline void  _avlp_set_balance(AVLPackedNode *node, int balance);
+extern AVLPackedTree tree_avl_packed_create(idx_t initial_capacity);
+extern void     tree_avl_packed_destroy(AVLPackedTree *avl);
+extern void     tree_avl_packed_resize(AVLPackedTree *avl);
+static idx_t    _avlp_rotate_right(AVLPackedTree *avl, idx_t node_idx);
+static idx_t    _avlp_rotate_left(AVLPackedTree *avl, idx_t node_idx);
+static idx_t    _avlp_rebalance(AVLPackedTree *avl, idx_t node_idx, int balance);
+extern void     tree_avl_packed_insert(AVLPackedTree *avl, key_t key);
+extern idx_t    tree_avl_packed_search(AVLPackedTree *avl, key_t key);
+static inline idx_t _rbp_left(const RBPackedNode *node);
+static inline void  _rbp_set_left(RBPackedNode *node, idx_t left);
+static inline int   _rbp_color(const RBPackedNode *node);
+static inline void  _rbp_set_color(RBPackedNode *node, int color);
+static inline int   _rbp_is_red(RBPackedTree *tree, idx_t i);
+extern RBPackedTree tree_rb_packed_create(idx_t initial_capacity);
+extern void     tree_rb_packed_destroy(RBPackedTree *tree);
+extern void     tree_rb_packed_resize(RBPackedTree *tree);
+static idx_t    _rbp_rotate_left(RBPackedTree *tree, idx_t h);
+static idx_t    _rbp_rotate_right(RBPackedTree *tree, idx_t h);
+static void     _rbp_flip_colors(RBPackedTree *tree, idx_t h);
+static idx_t    _rbp_fix_up(RBPackedTree *tree, idx_t h, int *changed);
+extern void     tree_rb_packed_insert(RBPackedTree *tree, key_t key);
+extern idx_t    tree_rb_packed_search(RBPackedTree *tree, key_t key);
+extern void     packed_test_and_log(key_t* arr, FILE *fptr); // 16 contra 12 bytes por nó
+
+/* ===== B+ TREE ===== */
+extern BTree    tree_btree_create(idx_t initial_capacity); // capacidade em folhas
+extern void     tree_btree_destroy(BTree *bt);
+static void     *_btree_grow(void *nodes, size_t node_size, idx_t elements, idx_t *capacity);
+static idx_t    _btree_new_inner(BTree *bt);
+static idx_t    _btree_new_leaf(BTree *bt);
+static int      _btree_inner_rank(const BTreeInner *node, key_t key); // filho a seguir
+static int      _btree_leaf_lower(const BTreeLeaf *leaf, key_t key); // primeira posição >= key
+extern void     tree_btree_insert(BTree *bt, key_t key);
+extern void     tree_btree_insert_arr(BTree *bt, key_t* arr, size_t size);
+extern BTree    tree_btree_build_sorted(key_t* arr, size_t size);
+extern idx_t    tree_btree_search(BTree *bt, key_t key); // folha*BTREE_LEAF_KEYS + posição, ou IDX_INVALID
+extern void     tree_btree_search_batch(BTree *bt, const key_t *keys, size_t n, idx_t *out_idx);
+extern void     btree_test_and_log(key_t* arr, FILE *fptr);
+
+/* ===== FROZEN TREES (EYTZINGER / VAN EMDE BOAS) ===== */
+extern size_t   tree_binary_sorted_keys(BinTree *btree, key_t *out); // chaves por ordem crescente
+extern size_t   tree_avl_sorted_keys(AVLTree *avl, key_t *out);
+extern size_t   tree_rb_sorted_keys(RBTree *tree, key_t *out);
+extern size_t   tree_treap_sorted_keys(Treap *treap, key_t *out);
+static void     _eytz_fill(EytzTree *eytz, const key_t *sorted, size_t *k, idx_t i);
+extern EytzTree tree_eytz_freeze(const key_t *sorted, idx_t n); // chaves únicas crescentes
+extern void     tree_eytz_destroy(EytzTree *eytz);
+extern idx_t    tree_eytz_search(EytzTree *eytz, key_t key); // posição em keys ou IDX_INVALID
+extern void     tree_eytz_search_batch(EytzTree *eytz, const key_t *keys, size_t n, idx_t *out_idx);
+static void     _veb_levels(VebTree *veb, int depth, int height);
+static void     _veb_fill(VebTree *veb, const key_t *sorted, idx_t *pos, idx_t i, int depth);
+extern VebTree  tree_veb_freeze(const key_t *sorted, idx_t n);
+extern void     tree_veb_destroy(VebTree *veb);
+extern idx_t    tree_veb_search(VebTree *veb, key_t key);
+extern void     tree_veb_search_batch(VebTree *veb, const key_t *keys, size_t n, idx_t *out_idx);
+
+/* ===== ORDER STATISTICS (TREE_ORDER_STATS) ===== */
+#ifdef TREE_ORDER_STATS
+static idx_t    _arena_rank(const char *nodes, size_t stride, size_t key_offset, size_t left_offset,
+                            size_t right_offset, size_t size_offset, idx_t root, key_t key);
+static idx_t    _arena_select(const char *nodes, size_t stride, size_t left_offset,
+                              size_t right_offset, size_t size_offset, idx_t root, idx_t k);
+extern idx_t    tree_avl_rank(AVLTree *avl, key_t key); // chaves < key
+extern idx_t    tree_avl_select(AVLTree *avl, idx_t k); // nó da k-ésima menor chave (a partir de 0) ou IDX_INVALID
+extern idx_t    tree_rb_rank(RBTree *tree, key_t key);
+extern idx_t    tree_rb_select(RBTree *tree, idx_t k);
+extern idx_t    tree_treap_rank(Treap *treap, key_t key);
+extern idx_t    tree_treap_select(Treap *treap, idx_t k);
+extern void     order_test_and_log(key_t* arr, FILE *fptr);
+#endif
+
+/* ===== CURSOR ===== */
+extern TreeCursor tree_avl_cursor(AVLTree *avl); // começa fora da árvore
+extern TreeCursor tree_rb_cursor(RBTree *tree);
+extern TreeCursor tree_treap_cursor(Treap *treap);
+static int      _cursor_seek(TreeCursor *cur, key_t key, int dir, int strict);
+static int      _cursor_step(TreeCursor *cur, int dir);
+extern int      tree_cursor_first(TreeCursor *cur); // 1 se ficou numa chave
+extern int      tree_cursor_last(TreeCursor *cur);
+extern int      tree_cursor_lower_bound(TreeCursor *cur, key_t key); // primeira chave >= key
+extern int      tree_cursor_upper_bound(TreeCursor *cur, key_t key); // primeira chave > key
+extern int      tree_cursor_next(TreeCursor *cur);
+extern int      tree_cursor_prev(TreeCursor *cur);
+extern key_t    tree_cursor_key(const TreeCursor *cur); // só com o cursor numa chave
+extern size_t   tree_cursor_range_count(TreeCursor *cur, key_t lo, key_t hi); // chaves em [lo, hi]
+extern void     cursor_test_and_log(key_t* arr, FILE *fptr); // varrimento com cursor contra pesquisas pontuais
+
+/* ===== SNAPSHOT AVL (EPOCH) ===== */
+extern SnapTree  tree_snap_create(void);
+extern void      tree_snap_destroy(SnapTree *tree);
+static inline SnapNode* _snap_node(const SnapTree *tree, idx_t idx);
+static idx_t     _snap_alloc(SnapTree *tree);
+static idx_t     _snap_copy(SnapTree *tree, idx_t old); // cópia nova, o original fica retirado
+static idx_t     _snap_rotate_right(SnapTree *tree, idx_t node_idx);
+static idx_t     _snap_rotate_left(SnapTree *tree, idx_t node_idx);
+static idx_t     _snap_insert_recursive(SnapTree *tree, idx_t node_idx, key_t key);
+static void      _snap_reclaim(SnapTree *tree);
+extern void      tree_snap_insert(SnapTree *tree, key_t key); // só o escritor, publica uma versão nova
+extern void      tree_snap_insert_arr(SnapTree *tree, const key_t *arr, size_t size);
+extern idx_t     tree_snap_read_begin(SnapTree *tree, int reader); // raiz do snapshot, reader < SNAP_MAX_READERS
+extern void      tree_snap_read_end(SnapTree *tree, int reader);
+extern idx_t     tree_snap_search(const SnapTree *tree, idx_t root, key_t key); // dentro de read_begin/read_end
+static void*     _snap_reader_thread(void *arg);
+extern void      snap_test_and_log(key_t* arr, FILE *fptr); // leitores de 1 a 64 com o escritor a inserir
+
+/* ===== LOCK-FREE SKIP LIST ===== */
+extern SkipList  tree_skiplist_create(idx_t expected_keys); // arena fixo para ~expected_keys chaves
+extern void      tree_skiplist_destroy(SkipList *list);
+static inline SkipNode* _skip_node(const SkipList *list, idx_t offset);
+static int       _skip_find(SkipList *list, key_t key, idx_t *preds, idx_t *succs);
+extern int       tree_skiplist_insert(SkipList *list, key_t key, idx_t *rng); // 1 se inseriu, seguro entre threads
+extern idx_t     tree_skiplist_search(SkipList *list, key_t key); // offset do nó ou IDX_INVALID
+extern void      tree_skiplist_search_batch(SkipList *list, const key_t *keys, size_t n, idx_t *out_idx);
+static void*     _skip_writer_thread(void *arg);
+extern void      skiplist_test_and_log(key_t* arr, FILE *fptr); // inserção com 1 a 64 threads, RB e Treap ao lado
+
+/* ===== FORK-JOIN POOL ===== */
+extern ForkJoinPool* forkjoin_create(int nthreads);
+extern void          forkjoin_destroy(ForkJoinPool *pool);
+static void          _forkjoin_run(ForkJoinTask *task);
+static void*         _forkjoin_worker(void *arg);
+extern void          forkjoin_fork(ForkJoinPool *pool, ForkJoinTask *task);
+extern void          forkjoin_join(ForkJoinPool *pool, ForkJoinTask *task);
+
+/* ===== TREAP SPLIT / MERGE ===== */
+extern idx_t tree_treap_split(Treap *treap, idx_t root, key_t key, idx_t *less, idx_t *greater); // devolve o nó igual a key
+extern idx_t tree_treap_merge(Treap *treap, idx_t less, idx_t greater); // todas as chaves de less < as de greater
+static idx_t _treap_absorb(Treap *treap, Treap *other);
+static idx_t _treap_set_op(Treap *treap, ForkJoinPool *pool, int op, idx_t a, idx_t b, size_t estimate);
+static void  _treap_set_task_run(void *arg);
+static void  _treap_set(Treap *treap, Treap *other, ForkJoinPool *pool, int op);
+extern void  tree_treap_union(Treap *treap, Treap *other, ForkJoinPool *pool); // other é destruída, pool pode ser NULL
+extern void  tree_treap_intersect(Treap *treap, Treap *other, ForkJoinPool *pool);
+extern void  tree_treap_difference(Treap *treap, Treap *other, ForkJoinPool *pool);
+static Treap _treap_clone(const Treap *treap);
+static double _wall_seconds(void);
+extern void  treap_set_test_and_log(key_t* arr, FILE *fptr); // união contra inserções, interseção e diferença
 
 /* ==== FUNCTION DECLATRATIONS ==== */
 static inline int 
@@ -155,12 +681,17 @@ randint(int a, int b) {
 
 static idx_t rng_state = SEED;
 
+static inline idx_t
+xorshift_next(idx_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
 static inline idx_t
 rand_idx(idx_t a, idx_t b) {
-    rng_state ^= rng_state << 13;
-    rng_state ^= rng_state >> 17;
-    rng_state ^= rng_state << 5;
-    return a + rng_state % (b - a + 1);
+    return a + xorshift_next(&rng_state) % (b - a + 1);
 }
 
 static inline int
@@ -248,10 +779,153 @@ arr_print(key_t* arr, key_t size) {
         printf("arr[%d] = %d\n", k, arr[k]);
 }
 
+static int
+arr_sorted_order(const key_t* arr, size_t size) {
+    int up = 1, down = 1;
+    for (size_t k = 1; k < size && (up || down); k++) {
+        if (arr[k] < arr[k-1]) up = 0;
+        if (arr[k] > arr[k-1]) down = 0;
+    }
+    return up ? 1 : (down ? -1 : 0);
+}
+
+static int
+_key_cmp(const void *a, const void *b) {
+    key_t x = *(const key_t*) a, y = *(const key_t*) b;
+    return (x > y) - (x < y);
+}
+
+/* Escreve as chaves únicas por ordem crescente em out, com stride bytes entre elas,
+ * para poder escrever direto no campo key dos nós. Conjuntos A e B passam numa só
+ * passagem (lidos para a frente ou para trás), os outros são ordenados numa cópia */
+static size_t
+arr_unique_sorted(const key_t* arr, size_t size, key_t* out, size_t stride) {
+    if (size == 0) return 0;
+
+    key_t* sorted = NULL;
+    int order = arr_sorted_order(arr, size);
+    if (order == 0) {
+        sorted = (key_t*) malloc(sizeof(key_t) * size);
+        if (sorted == NULL) {
+            perror("Failed to allocate sorted copy.");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(sorted, arr, sizeof(key_t) * size);
+        qsort(sorted, size, sizeof(key_t), _key_cmp);
+        arr = sorted;
+        order = 1;
+    }
+
+    char* dst = (char*) out;
+    size_t unique = 0;
+    for (size_t k = 0; k < size; k++) {
+        key_t key = (order == 1) ? arr[k] : arr[size-1-k];
+        if (unique > 0 && key == *(key_t*) (dst - stride)) continue;
+        *(key_t*) dst = key;
+        dst += stride;
+        unique++;
+    }
+
+    free(sorted);
+    return unique;
+}
+
+#if defined(PERF) && defined(__linux__)
+static int
+_perf_event_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // permitido com perf_event_paranoid = 2
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Abre o que conseguir, os contadores que o kernel recusa ficam desligados */
+static void
+perf_open(PerfCounters *perf) {
+    static const uint32_t type[PERF_NCOUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+    };
+    static const uint64_t config[PERF_NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    perf->enabled = 0;
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+        perf->fd[c] = _perf_event_open(type[c], config[c]);
+        perf->value[c] = 0;
+        if (perf->fd[c] >= 0) perf->enabled = 1;
+    }
+}
+
+static void
+perf_close(PerfCounters *perf) {
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+        if (perf->fd[c] >= 0) close(perf->fd[c]);
+        perf->fd[c] = -1;
+    }
+    perf->enabled = 0;
+}
+
+static void
+perf_start(PerfCounters *perf) {
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+        if (perf->fd[c] < 0) continue;
+        ioctl(perf->fd[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf->fd[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static void
+perf_stop(PerfCounters *perf) {
+    for (int c = 0; c < PERF_NCOUNTERS; c++) {
+        uint64_t count;
+        if (perf->fd[c] < 0) continue;
+        ioctl(perf->fd[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf->fd[c], &count, sizeof(count)) == sizeof(count)) perf->value[c] += count;
+    }
+}
+#else
+static void perf_open(PerfCounters *perf) { perf->enabled = 0; }
+static void perf_close(PerfCounters *perf) { (void) perf; }
+static void perf_start(PerfCounters *perf) { (void) perf; }
+static void perf_stop(PerfCounters *perf) { (void) perf; }
+#endif
+
+static void
+perf_clear(PerfCounters *perf) {
+    memset(perf->value, 0, sizeof(perf->value));
+}
+
+/* Média por iteração ao lado do tempo, sem nada se não houver contadores */
+static void
+perf_log(FILE *fptr, PerfCounters *perf, int iterations) {
+    static const char *names[PERF_NCOUNTERS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+    if (perf->enabled && iterations > 0) {
+        fprintf(fptr, "\t[");
+        for (int c = 0, first = 1; c < PERF_NCOUNTERS; c++) {
+            if (perf->fd[c] < 0) continue;
+            fprintf(fptr, "%s%s=%llu", first ? "" : " ", names[c], (unsigned long long) (perf->value[c] / iterations));
+            first = 0;
+        }
+        fprintf(fptr, "]");
+    }
+    fprintf(fptr, "\n");
+}
+
 
 BinTree
 tree_binary_create(uint32_t initial_capacity) {
-    BinTree btree = {initial_capacity, 0, NULL};
+    BinTree btree = {initial_capacity, 0, NULL, NULL, 0};
     btree.root = (BinTreeNode*) malloc(sizeof(BinTreeNode)*initial_capacity);
 
     if (btree.root) {
@@ -269,6 +943,67 @@ tree_binary_create(uint32_t initial_capacity) {
 void
 tree_binary_destroy(BinTree btree) {
     free(btree.root);
+    free(btree.hash);
+}
+
+/* Open addressing com linear probing sobre os índices dos nós: a chave fica no
+ * arena e a tabela só guarda onde está, IDX_INVALID marca um slot vazio.
+ * O fator de carga nunca passa de 1/2 porque a tabela acompanha a capacidade */
+void
+tree_binary_hash_enable(BinTree *btree) {
+    if (btree->hash != NULL) return;
+    _binary_hash_rebuild(btree, btree->capacity);
+}
+
+static void
+_binary_hash_rebuild(BinTree *btree, uint32_t min_slots) {
+    uint32_t bits = 4;
+    while (bits < 31 && ((uint32_t) 1 << bits) < 2*(uint64_t) min_slots) bits++;
+
+    free(btree->hash);
+    btree->hash = (idx_t*) malloc(sizeof(idx_t) << bits);
+    if (btree->hash == NULL) {
+        puts("Failed to allocate binary tree hash index.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(btree->hash, 0xFF, sizeof(idx_t) << bits); // tudo a IDX_INVALID
+    btree->hash_bits = bits;
+
+    for (idx_t idx = 0; idx < btree->elements; idx++)
+        *_binary_hash_slot(btree, btree->root[idx].data) = idx;
+}
+
+static idx_t*
+_binary_hash_slot(const BinTree *btree, key_t key) {
+    uint32_t mask = ((uint32_t) 1 << btree->hash_bits) - 1;
+    uint32_t pos = ((uint32_t) key * BINARY_HASH_MUL) >> (32 - btree->hash_bits);
+
+    idx_t *hash = btree->hash;
+    while (hash[pos] != IDX_INVALID && btree->root[hash[pos]].data != key)
+        pos = (pos + 1) & mask;
+    return &hash[pos];
+}
+
+/* Sem tombstones: os slots seguintes do mesmo cluster que possam ocupar o
+ * buraco recuam, para que nenhuma procura pare antes do tempo */
+static void
+_binary_hash_erase(BinTree *btree, idx_t *slot) {
+    uint32_t mask = ((uint32_t) 1 << btree->hash_bits) - 1;
+    idx_t *hash = btree->hash;
+    uint32_t hole = slot - hash;
+    uint32_t pos = hole;
+
+    for (;;) {
+        pos = (pos + 1) & mask;
+        if (hash[pos] == IDX_INVALID) break;
+
+        uint32_t home = ((uint32_t) btree->root[hash[pos]].data * BINARY_HASH_MUL) >> (32 - btree->hash_bits);
+        /* fica se home estiver ciclicamente em ]hole, pos] */
+        if (((pos - home) & mask) < ((pos - hole) & mask)) continue;
+        hash[hole] = hash[pos];
+        hole = pos;
+    }
+    hash[hole] = IDX_INVALID;
 }
 
 void
@@ -291,13 +1026,18 @@ tree_binary_resize(BinTree *btree) {
 
     btree->root = new_root;
     btree->capacity = new_capacity;
+
+    if (btree->hash != NULL && ((uint64_t) 2*new_capacity > ((uint64_t) 1 << btree->hash_bits)))
+        _binary_hash_rebuild(btree, new_capacity);
 }
 
 void
 tree_binary_insert(BinTree *btree, key_t key) {
 
     /* NA OPERAÇÃO DE INSERÇÃO QUANDO UMA CHAVE JÁ EXISTIR, NÃO É CRIADA NOVA CHAVE */
-    if (IDX_INVALID != tree_binary_search_key_level(*btree, key)) {
+    if (btree->hash != NULL) {
+        if (*_binary_hash_slot(btree, key) != IDX_INVALID) return;
+    } else if (IDX_INVALID != tree_binary_search_key_level(*btree, key)) {
         return;
     };
 
@@ -333,9 +1073,15 @@ tree_binary_insert(BinTree *btree, key_t key) {
         }
     }
 
-    /* Inserir nova chave  */
+    /* Inserir nova chave, os nós vindos do realloc não estão a zero */
     node->data = key;
+    node->idx_left = 0;
+    node->idx_right = 0;
     btree->elements = inicial_elements + 1;
+
+    /* Depois do resize, o slot vazio tem de ser procurado já na tabela nova */
+    if (btree->hash != NULL)
+        *_binary_hash_slot(btree, key) = inicial_elements;
 }
 
 void
@@ -435,8 +1181,10 @@ tree_binary_search_key_level(BinTree btree, int32_t key) {
      * inseridos no array da esquerda para a direita, logo posso percorrer o array.
      * Vou optimizar porque sim. */
 
+    if (btree.elements == 0) return IDX_INVALID;
+
     register BinTreeNode *ptr_front = btree.root;
-    register BinTreeNode *ptr_back = btree.root + btree.elements;
+    register BinTreeNode *ptr_back = btree.root + btree.elements - 1; // último nó ocupado
 
     /*printf("Search key = %d\n", key);*/
 
@@ -474,6 +1222,57 @@ tree_binary_search_key_level(BinTree btree, int32_t key) {
     return found ? 0 : IDX_INVALID;
 }
 
+/* A árvore implícita tem de continuar contígua: a chave do último nó passa para
+ * o lugar da apagada e o último sai, desligando-o do pai (último>>1) */
+int
+tree_binary_delete(BinTree *btree, key_t key) {
+    BinTreeNode *root = btree->root;
+    idx_t found = IDX_INVALID;
+    if (btree->hash != NULL) {
+        idx_t *slot = _binary_hash_slot(btree, key);
+        found = *slot;
+        if (found == IDX_INVALID) return 0;
+        _binary_hash_erase(btree, slot);
+    } else {
+        for (idx_t idx = 0; idx < btree->elements; idx++) {
+            if (root[idx].data == key) {
+                found = idx;
+                break;
+            }
+        }
+        if (found == IDX_INVALID) return 0;
+    }
+
+    idx_t last = btree->elements - 1;
+    if (btree->hash != NULL && found != last)
+        *_binary_hash_slot(btree, root[last].data) = found;
+    root[found].data = root[last].data;
+    if (last > 0) {
+        if (last % 2 == 0) root[last>>1].idx_left = 0;
+        else root[last>>1].idx_right = 0;
+    }
+    root[last] = (BinTreeNode) {0, 0, 0};
+    btree->elements = last;
+    return 1;
+}
+
+void
+tree_binary_compact(BinTree *btree) {
+    uint32_t new_capacity = (btree->elements > 10) ? btree->elements : 10;
+    if (new_capacity >= btree->capacity) return;
+
+    BinTreeNode *new_root = (BinTreeNode*) realloc(btree->root, sizeof(BinTreeNode)*new_capacity);
+    if (new_root == NULL) {
+        puts("Failed to shrink binary tree.\n");
+        exit(EXIT_FAILURE);
+    }
+    btree->root = new_root;
+    btree->capacity = new_capacity;
+
+    if (btree->hash != NULL)
+        _binary_hash_rebuild(btree, new_capacity);
+}
+
 void
 binary_test_and_log(key_t* arr, FILE *fptr) {
 
@@ -481,655 +1280,4737 @@ binary_test_and_log(key_t* arr, FILE *fptr) {
     clock_t start = 0, end = 0;
     clock_t total = 0;
 
+    perf_clear(&g_perf);
     for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
         start = clock();
         btree = tree_binary_create(g_treesize);
         tree_binary_insert_arr(&btree, arr, g_treesize);
         end = clock();
+        perf_stop(&g_perf);
 
         total += (end-start);
         tree_binary_destroy(btree);
     }
 
     double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
-    fprintf(fptr, "Binary Tree = %0.4lfms\t(0 rotations)\n", total_time/g_average);
-}
+    fprintf(fptr, "Binary Tree = %0.4lfms\t(0 rotations)", total_time/g_average);
+    perf_log(fptr, &g_perf, g_average);
 
-AVLTree
-tree_avl_create(idx_t inicial_capacity) {
-    assert(inicial_capacity > 0);
+    /* A mesma construção com o índice de hash para os duplicados */
+    total = 0;
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        btree = tree_binary_create(g_treesize);
+        tree_binary_hash_enable(&btree);
+        tree_binary_insert_arr(&btree, arr, g_treesize);
+        end = clock();
+        perf_stop(&g_perf);
 
-    AVLTree avl = {NULL, 0, 0, inicial_capacity};
-    avl.nodes = (AVLNode*) malloc( sizeof(AVLNode) * inicial_capacity);
+        total += (end-start);
+        tree_binary_destroy(btree);
+    }
 
-    if (avl.nodes == NULL) {
-        perror("Couldn't allocate AVL tree.");
+    total_time = ((double) total*1000) / CLOCKS_PER_SEC;
+    fprintf(fptr, "Binary Tree (hash) = %0.4lfms\t(0 rotations)", total_time/g_average);
+    perf_log(fptr, &g_perf, g_average);
+}
+
+BinTreeSoA
+tree_binary_soa_create(uint32_t initial_capacity) {
+    BinTreeSoA tree = {initial_capacity, 0, NULL, NULL, NULL};
+    if (tree.capacity == 0) tree.capacity = 1;
+
+    if (posix_memalign((void**) &tree.keys, 64, sizeof(key_t) * tree.capacity) != 0) {
+        perror("Failed to allocate binary tree keys.");
         exit(EXIT_FAILURE);
     }
-
-    for (idx_t i = 0; i < inicial_capacity; i++) {
-        avl.nodes[i] = (AVLNode) {IDX_INVALID, IDX_INVALID, 0, 1};
+    tree.idx_left = (idx_t*) calloc(tree.capacity, sizeof(idx_t));
+    tree.idx_right = (idx_t*) calloc(tree.capacity, sizeof(idx_t));
+    if (tree.idx_left == NULL || tree.idx_right == NULL) {
+        perror("Failed to allocate binary tree links.");
+        exit(EXIT_FAILURE);
     }
 
-    return avl;
+    return tree;
+}
+
+BinTreeSoA
+tree_binary_soa_from(const BinTree *btree) {
+    BinTreeSoA tree = tree_binary_soa_create(btree->elements);
+    for (idx_t idx = 0; idx < btree->elements; idx++) {
+        tree.keys[idx] = btree->root[idx].data;
+        tree.idx_left[idx] = btree->root[idx].idx_left;
+        tree.idx_right[idx] = btree->root[idx].idx_right;
+    }
+    tree.elements = btree->elements;
+    return tree;
 }
 
 void
-tree_avl_destroy(AVLTree* avl) {
-    assert(avl);
-    free(avl->nodes);
+tree_binary_soa_destroy(BinTreeSoA tree) {
+    free(tree.keys);
+    free(tree.idx_left);
+    free(tree.idx_right);
 }
 
+/* realloc não mantém o alinhamento das chaves, essas são copiadas à mão */
 void
-tree_avl_resize(AVLTree *avl) {
-    idx_t new_capacity = avl->capacity*RESIZE_FACTOR;
-    if (new_capacity >= IDX_INVALID) {
-        perror("AVL tree exceeded maximum capacity.");
+tree_binary_soa_resize(BinTreeSoA *tree) {
+    uint32_t new_capacity = tree->capacity*RESIZE_FACTOR;
+    if (new_capacity <= tree->capacity) new_capacity = tree->capacity + 1;
+
+    key_t *new_keys = NULL;
+    if (posix_memalign((void**) &new_keys, 64, sizeof(key_t) * new_capacity) != 0) {
+        puts("Failed to allocate enough memory for tree resize.\n");
         exit(EXIT_FAILURE);
     }
+    memcpy(new_keys, tree->keys, sizeof(key_t) * tree->elements);
+    free(tree->keys);
+    tree->keys = new_keys;
 
-    AVLNode* new_nodes = (AVLNode*) realloc(avl->nodes, sizeof(AVLNode)*new_capacity);
-    if (new_nodes == NULL) {
-        perror("Failed to allocate enough memory for tree resize.");
+    idx_t *new_left = (idx_t*) realloc(tree->idx_left, sizeof(idx_t) * new_capacity);
+    idx_t *new_right = (idx_t*) realloc(tree->idx_right, sizeof(idx_t) * new_capacity);
+    if (new_left == NULL || new_right == NULL) {
+        puts("Failed to allocate enough memory for tree resize.\n");
         exit(EXIT_FAILURE);
     }
-
-    avl->nodes = new_nodes;        
-    avl->capacity = new_capacity;
+    memset(new_left + tree->capacity, 0, sizeof(idx_t) * (new_capacity - tree->capacity));
+    memset(new_right + tree->capacity, 0, sizeof(idx_t) * (new_capacity - tree->capacity));
+    tree->idx_left = new_left;
+    tree->idx_right = new_right;
+    tree->capacity = new_capacity;
 }
 
+/* Como tree_binary_insert: o novo nó é sempre o índice elements e o pai é elements>>1 */
+void
+tree_binary_soa_insert(BinTreeSoA *tree, key_t key) {
+    if (tree_binary_soa_search(tree, key) != IDX_INVALID) return;
 
-static int
-_avl_get_height(AVLTree* avl, idx_t index) {
-    return (index == IDX_INVALID) ? 0 : avl->nodes[index].height;
-}
+    if (tree->elements == tree->capacity)
+        tree_binary_soa_resize(tree);
 
-static int
-_avl_get_balance(AVLTree* avl, idx_t index) {
-    if (index == IDX_INVALID) return 0;
-    return _avl_get_height(avl, avl->nodes[index].left) - _avl_get_height(avl, avl->nodes[index].right);
+    idx_t new_index = tree->elements;
+    if (new_index > 0) {
+        if (new_index % 2 == 0) tree->idx_left[new_index>>1] = new_index;
+        else tree->idx_right[new_index>>1] = new_index;
+    }
+    tree->keys[new_index] = key;
+    tree->elements = new_index + 1;
 }
 
+void
+tree_binary_soa_insert_arr(BinTreeSoA *tree, key_t* arr, key_t size) {
+    for (key_t k = 0; k < size; k++) {
+        tree_binary_soa_insert(tree, arr[k]);
+    }
+}
 
 static idx_t
-_avl_rotate_right(AVLTree *avl, idx_t node_idx) {
-    g_rotation_count++;
-
-    idx_t pivot = avl->nodes[node_idx].left;
-    idx_t T2 = avl->nodes[pivot].right;
-
-    // Perform rotation:
-    avl->nodes[pivot].right = node_idx;
-    avl->nodes[node_idx].left = T2;
-
-    // Update heights:
-    avl->nodes[node_idx].height = 1 + max(_avl_get_height(avl, avl->nodes[node_idx].left), _avl_get_height(avl, avl->nodes[node_idx].right));
-    avl->nodes[pivot].height = 1 + max(_avl_get_height(avl, avl->nodes[pivot].left), _avl_get_height(avl, avl->nodes[pivot].right));
-    return pivot;
+_binary_keys_find_scalar(const key_t *keys, idx_t elements, key_t key) {
+    for (idx_t idx = 0; idx < elements; idx++) {
+        if (keys[idx] == key) return idx;
+    }
+    return IDX_INVALID;
 }
 
+#ifdef BTREE_HAVE_X86
+/* 32 chaves (duas linhas de cache) por iteração; o OR das quatro comparações
+ * só se desfaz em máscara quando há um acerto, e o ctz dá a primeira posição */
+__attribute__((target("avx2")))
 static idx_t
-_avl_rotate_left(AVLTree *avl, idx_t x_index) {
-    g_rotation_count++;
+_binary_keys_find_avx2(const key_t *keys, idx_t elements, key_t key) {
+    __m256i k = _mm256_set1_epi32(key);
+
+    idx_t idx = 0;
+    for (; idx + 32 <= elements; idx += 32) {
+        __m256i e0 = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*) (keys + idx)), k);
+        __m256i e1 = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*) (keys + idx + 8)), k);
+        __m256i e2 = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*) (keys + idx + 16)), k);
+        __m256i e3 = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*) (keys + idx + 24)), k);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(e0, e1), _mm256_or_si256(e2, e3));
+        if (!_mm256_testz_si256(any, any)) {
+            uint32_t mask = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(e0))
+                          | (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(e1)) << 8
+                          | (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(e2)) << 16
+                          | (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(e3)) << 24;
+            return idx + __builtin_ctz(mask);
+        }
+    }
 
-    idx_t pivot = avl->nodes[x_index].right;
-    idx_t T2 = avl->nodes[pivot].left;
+    for (; idx < elements; idx++) {
+        if (keys[idx] == key) return idx;
+    }
+    return IDX_INVALID;
+}
+#endif
 
-    // Perform rotation:
-    avl->nodes[pivot].left = x_index;
-    avl->nodes[x_index].right = T2;
+/* keys tem de estar alinhado a 32 bytes */
+static idx_t
+_binary_keys_find(const key_t *keys, idx_t elements, key_t key) {
+#ifdef BTREE_HAVE_X86
+    if (__builtin_cpu_supports("avx2"))
+        return _binary_keys_find_avx2(keys, elements, key);
+#endif
+    return _binary_keys_find_scalar(keys, elements, key);
+}
 
-    // Update heights:
-    avl->nodes[x_index].height = 1 + max(_avl_get_height(avl, avl->nodes[x_index].left), _avl_get_height(avl, avl->nodes[x_index].right));
-    avl->nodes[pivot].height = 1 + max(_avl_get_height(avl, avl->nodes[pivot].left), _avl_get_height(avl, avl->nodes[pivot].right));
-    return pivot;
+idx_t
+tree_binary_soa_search(const BinTreeSoA *tree, key_t key) {
+    return _binary_keys_find(tree->keys, tree->elements, key);
 }
 
-static idx_t
-_avl_insert_recursive(AVLTree *avl, idx_t node_index, int key) {
-    
-    if (node_index == IDX_INVALID) {
+/* Pesquisa de uma chave que não existe, o pior caso: as duas versões percorrem
+ * o array inteiro. GB/s contam só as chaves (4 bytes por nó), embora a versão
+ * AoS traga os 12 bytes de cada nó da memória */
+void
+soa_test_and_log(key_t* arr, FILE *fptr) {
 
-        idx_t new_index = avl->elements;
-        AVLNode* new_node = &avl->nodes[new_index];
-        new_node->key = key;
-        new_node->left = IDX_INVALID;
-        new_node->right = IDX_INVALID;
-        new_node->height = 1;
-        avl->elements++;
-        return new_index;
+    BinTree btree = tree_binary_create(g_treesize);
+    tree_binary_hash_enable(&btree);
+    tree_binary_insert_arr(&btree, arr, g_treesize);
+    BinTreeSoA soa = tree_binary_soa_from(&btree);
 
+    key_t absent = INT32_MIN;
+    for (idx_t idx = 0; idx < btree.elements; idx++) {
+        if (btree.root[idx].data >= absent) absent = btree.root[idx].data;
     }
-    
-    /* Binary Search Tree */
-    if (key < avl->nodes[node_index].key) {
-        avl->nodes[node_index].left = _avl_insert_recursive(avl, avl->nodes[node_index].left, key);
-    } else if (key > avl->nodes[node_index].key) {
-        avl->nodes[node_index].right = _avl_insert_recursive(avl, avl->nodes[node_index].right, key);
-    } else {
-        return node_index;
-    }
-    
-    avl->nodes[node_index].height = 1 + max(_avl_get_height(avl, avl->nodes[node_index].left),
-                                             _avl_get_height(avl, avl->nodes[node_index].right));
+    absent = (absent == INT32_MAX) ? INT32_MIN : absent + 1;
+    while (*_binary_hash_slot(&btree, absent) != IDX_INVALID) absent++;
 
-    // Get balance factor to check if rebalancing is needed.
-    int balance = _avl_get_balance(avl, node_index);
+    /* ~256MB de chaves lidas por medição, para não medir só o clock() */
+    int reps = 1 + (int) ((1u << 26) / (btree.elements + 1));
+    double bytes = (double) btree.elements * sizeof(key_t) * reps * g_average;
+    clock_t start = 0, end = 0;
+    clock_t total_aos = 0, total_soa = 0, total_scalar = 0;
+    volatile idx_t sink = 0;
 
-    /* Left Left */
-    if (balance > 1 && key < avl->nodes[avl->nodes[node_index].left].key)
-        return _avl_rotate_right(avl, node_index);
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (int r = 0; r < reps; r++) sink = tree_binary_search_key_level(btree, absent);
+        end = clock();
+        total_aos += (end-start);
 
-    /* Right Right */
-    if (balance < -1 && key > avl->nodes[avl->nodes[node_index].right].key)
-        return _avl_rotate_left(avl, node_index);
+        start = clock();
+        for (int r = 0; r < reps; r++) sink = _binary_keys_find_scalar(soa.keys, soa.elements, absent);
+        end = clock();
+        total_scalar += (end-start);
 
-    /* Left Right */
-    if (balance > 1 && key > avl->nodes[avl->nodes[node_index].left].key) {
-        avl->nodes[node_index].left = _avl_rotate_left(avl, avl->nodes[node_index].left);
-        return _avl_rotate_right(avl, node_index);
+        start = clock();
+        for (int r = 0; r < reps; r++) sink = tree_binary_soa_search(&soa, absent);
+        end = clock();
+        total_soa += (end-start);
     }
+    (void) sink;
+
+    /* o índice devolvido tem de ser o do nó */
+    idx_t probe = btree.elements / 2;
+    int index_ok = (btree.elements == 0) || tree_binary_soa_search(&soa, soa.keys[probe]) == probe;
+
+    fprintf(fptr, "Binary Tree key scan (%u keys): AoS unrolled = %0.2lfGB/s\tSoA scalar = %0.2lfGB/s\tSoA %s = %0.2lfGB/s%s\n",
+            btree.elements,
+            bytes / ((double) (total_aos ? total_aos : 1) / CLOCKS_PER_SEC) / 1e9,
+            bytes / ((double) (total_scalar ? total_scalar : 1) / CLOCKS_PER_SEC) / 1e9,
+#ifdef BTREE_HAVE_X86
+            __builtin_cpu_supports("avx2") ? "AVX2" : "scalar",
+#else
+            "scalar",
+#endif
+            bytes / ((double) (total_soa ? total_soa : 1) / CLOCKS_PER_SEC) / 1e9,
+            index_ok ? "" : "\t(WRONG INDEX)");
+
+    tree_binary_soa_destroy(soa);
+    tree_binary_destroy(btree);
+}
 
-    /* Right Left */
-    if (balance < -1 && key < avl->nodes[avl->nodes[node_index].right].key) {
-        avl->nodes[node_index].right = _avl_rotate_right(avl, avl->nodes[node_index].right);
-        return _avl_rotate_left(avl, node_index);
+BinTreeImplicit
+tree_binary_implicit_create(uint32_t initial_capacity) {
+    BinTreeImplicit tree = {initial_capacity, 0, NULL};
+    if (tree.capacity == 0) tree.capacity = 1;
+
+    if (posix_memalign((void**) &tree.keys, 64, sizeof(key_t) * tree.capacity) != 0) {
+        perror("Failed to allocate binary tree keys.");
+        exit(EXIT_FAILURE);
     }
+    return tree;
+}
 
-    return node_index;
+void
+tree_binary_implicit_destroy(BinTreeImplicit tree) {
+    free(tree.keys);
 }
 
 void
-tree_avl_insert(AVLTree *avl, int key) {
+tree_binary_implicit_resize(BinTreeImplicit *tree) {
+    uint32_t new_capacity = tree->capacity*RESIZE_FACTOR;
+    if (new_capacity <= tree->capacity) new_capacity = tree->capacity + 1;
 
-    if (avl->elements == avl->capacity) {
-        tree_avl_resize(avl);
+    key_t *new_keys = NULL;
+    if (posix_memalign((void**) &new_keys, 64, sizeof(key_t) * new_capacity) != 0) {
+        puts("Failed to allocate enough memory for tree resize.\n");
+        exit(EXIT_FAILURE);
     }
+    memcpy(new_keys, tree->keys, sizeof(key_t) * tree->elements);
+    free(tree->keys);
+    tree->keys = new_keys;
+    tree->capacity = new_capacity;
+}
 
+/* Não há ligações a escrever: a posição elements já é o filho certo de elements>>1 */
+void
+tree_binary_implicit_insert(BinTreeImplicit *tree, key_t key) {
+    if (_binary_keys_find(tree->keys, tree->elements, key) != IDX_INVALID) return;
 
-    /* For an empty tree, set the new node as root. */
-    if (avl->elements == 0) {
-        avl->tree_root = _avl_insert_recursive(avl, IDX_INVALID, key);
-    } else {
-        avl->tree_root = _avl_insert_recursive(avl, avl->tree_root, key);
+    if (tree->elements == tree->capacity)
+        tree_binary_implicit_resize(tree);
+
+    tree->keys[tree->elements++] = key;
+}
+
+void
+tree_binary_implicit_insert_arr(BinTreeImplicit *tree, key_t* arr, key_t size) {
+    for (key_t k = 0; k < size; k++) {
+        tree_binary_implicit_insert(tree, arr[k]);
     }
 }
+
 void
-tree_avl_in_order(AVLTree *avl) {
+tree_binary_implicit_print_inorder(BinTreeImplicit *tree) {
 
-    void _traverse(AVLNode *nodes, idx_t i) {
-        if (i == IDX_INVALID) return;
-        AVLNode no = nodes[i];
-        _traverse(nodes, no.left);
-        printf("%d ", no.key);
-        _traverse(nodes, no.right);
+    void inorder(BinTreeImplicit *tree, idx_t idx) {
+        if (idx == 0 || idx >= tree->elements) return;
+        (void) inorder(tree, 2*idx);
+        (void) printf("%d ", tree->keys[idx]);
+        (void) inorder(tree, 2*idx + 1);
     }
 
-    _traverse(avl->nodes, avl->tree_root);
-    puts("");
+    if (tree->elements == 0) return;
+    (void) printf("In-order traversal of the binary tree:\n");
+    (void) printf("%d ", tree->keys[0]);
+    (void) inorder(tree, 1);
+    (void) puts("\n");
 }
 
+/* Os mesmos níveis que tree_binary_print, mas sem deixar de fora o último nó */
 void
-tree_avl_in_order_non(AVLTree *avl) {
+tree_binary_implicit_print(BinTreeImplicit *tree) {
+    if (tree->elements == 0) return;
 
-    AVLNode current_node; 
-    idx_t current_index = avl->tree_root;
+    uint32_t levels = 0;
+    uint32_t n_elem = tree->elements;
+    while (n_elem > 1) {
+        n_elem = n_elem >> 1;
+        levels++;
+    }
 
-    while (current_index != IDX_INVALID) {
-        current_node = avl->nodes[avl->tree_root];
+    printf("%2d\n", tree->keys[0]);
 
-        /* Traverse left sub-tree until leaf */
-        if (current_node.left != IDX_INVALID) {
-            current_index = current_node.left;
-            continue;
+    uint32_t idx = 1;
+    uint32_t n_nodes = 1;
+    for (uint32_t l = 0; l < levels; l++) {
+        n_nodes = n_nodes << 1;
+        for (uint32_t i = 0; i < n_nodes && idx < tree->elements; i++) {
+            printf("%2d  ", tree->keys[idx]);
+            idx++;
         }
-        printf("%d ", current_node.key);
+        puts("");
     }
 }
 
+idx_t
+tree_binary_implicit_search_key_inorder(BinTreeImplicit tree, int32_t key) {
 
-AVLNode*
-tree_avl_search(AVLTree *avl, int key) {
-    idx_t current_index = avl->tree_root;
-    while (current_index != IDX_INVALID) {
-        if (avl->nodes[current_index].key == key)
-            return &avl->nodes[current_index];
-            
-        else if (key < avl->nodes[current_index].key)
-            current_index = avl->nodes[current_index].left;
-
-        else
-            current_index = avl->nodes[current_index].right;
-    }
-    return NULL;  // Key not found.
-}
+    idx_t tree_binary_search(const BinTreeImplicit *tree, idx_t idx, int32_t key) {
+        if (idx == 0 || idx >= tree->elements) return IDX_INVALID;
+        if (tree->keys[idx] == key) return idx;
 
+        idx_t left = tree_binary_search(tree, 2*idx, key);
+        if (left != IDX_INVALID) return left;
 
-void
-tree_avl_insert_arr(AVLTree *avl, key_t* arr, size_t size) {
-    assert(avl && arr);
-    for (key_t* endptr = arr+size; arr != endptr && arr != NULL; arr++) {
-        tree_avl_insert(avl, *arr);
+        return tree_binary_search(tree, 2*idx + 1, key);
     }
+
+    if (tree.elements == 0) return IDX_INVALID;
+    if (tree.keys[0] == key) return 0;
+    return tree_binary_search(&tree, 1, key);
 }
 
+idx_t
+tree_binary_implicit_search_key_level(BinTreeImplicit tree, int32_t key) {
+    return _binary_keys_find(tree.keys, tree.elements, key);
+}
 
+/* A mesma construção (com pesquisa linear dos duplicados) nos três formatos.
+ * A memória é a do arena de nós no fim, capacidade * bytes por nó */
 void
-avl_test_and_log(key_t* arr, FILE *fptr) {
+implicit_test_and_log(key_t* arr, FILE *fptr) {
 
-    AVLTree avl;
     clock_t start = 0, end = 0;
-    clock_t total = 0;
-
-    /* Reset global rotation counter */
-    g_rotation_count = 0;
+    clock_t total_aos = 0, total_implicit = 0;
+    size_t bytes_aos = 0, bytes_implicit = 0;
+    uint32_t elements = 0;
 
     for (int i = 0; i < g_average; i++) {
         start = clock();
-        avl = tree_avl_create(10);
-        tree_avl_insert_arr(&avl, arr, g_treesize);
+        BinTree btree = tree_binary_create(10);
+        tree_binary_insert_arr(&btree, arr, g_treesize);
         end = clock();
+        total_aos += (end-start);
+        bytes_aos = (size_t) btree.capacity * sizeof(BinTreeNode);
+        tree_binary_destroy(btree);
 
-        total += (end-start);
-        tree_avl_destroy(&avl);
+        start = clock();
+        BinTreeImplicit tree = tree_binary_implicit_create(10);
+        tree_binary_implicit_insert_arr(&tree, arr, g_treesize);
+        end = clock();
+        total_implicit += (end-start);
+        bytes_implicit = (size_t) tree.capacity * sizeof(key_t);
+        elements = tree.elements;
+        tree_binary_implicit_destroy(tree);
     }
 
-    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
-    fprintf(fptr, "AVL Tree = %0.4lfms\t(%d rotations)\n", total_time/g_average, g_rotation_count/g_average);
+    fprintf(fptr, "Binary Tree = %0.4lfms\t(%zu bytes)\tImplicit = %0.4lfms\t(%zu bytes, %u keys)\n",
+            ((double) total_aos*1000) / CLOCKS_PER_SEC / g_average, bytes_aos,
+            ((double) total_implicit*1000) / CLOCKS_PER_SEC / g_average, bytes_implicit, elements);
 }
 
-/* Red Black Tree Implementation */
-/* Criar arvore */
-RBTree
-tree_rb_create(uint32_t initial_capacity) {
-    RBTree tree;
-    tree.nodes = malloc(initial_capacity * sizeof(RBNode));
-    assert(tree.nodes != NULL);
+/* Pré-ordem a partir da raiz: order[i] é o slot antigo que passa a ser o i,
+ * remap[antigo] o novo. Os filhos são lidos nos offsets dados para servir aos
+ * três arenas. Devolve o número de nós vivos */
+static idx_t
+_arena_preorder(const char *nodes, size_t stride, size_t left_offset, size_t right_offset,
+                idx_t root, idx_t slots, idx_t *order, idx_t *remap) {
+    idx_t *stack = (idx_t*) malloc(sizeof(idx_t) * (slots + 1));
+    if (stack == NULL) {
+        perror("Failed to allocate compact stack.");
+        exit(EXIT_FAILURE);
+    }
 
-    tree.elements = 0;
-    tree.capacity = initial_capacity;
+    idx_t count = 0, top = 0;
+    if (root != IDX_INVALID) stack[top++] = root;
+    while (top > 0) {
+        idx_t old = stack[--top];
+        remap[old] = count;
+        order[count++] = old;
+
+        idx_t left = *(const idx_t*) (nodes + stride*old + left_offset);
+        idx_t right = *(const idx_t*) (nodes + stride*old + right_offset);
+        if (right != IDX_INVALID) stack[top++] = right;
+        if (left != IDX_INVALID) stack[top++] = left;
+    }
 
-    // a raiz da arvore é invalida inicialmente
-    // para que seja pintada correctamente de preto (caso especial)
-    // e inserida imediatamente
-    tree.tree_root = IDX_INVALID;
+    free(stack);
+    return count;
+}
 
-    RBNode *endptr = tree.nodes+tree.capacity;
-    for (RBNode *ptr = tree.nodes; ptr != endptr; ptr++) {
-        ptr->key = 0;
-        ptr->color = -1;
-        ptr->left = IDX_INVALID;
-        ptr->right = IDX_INVALID;
+/* Até SEARCH_GROUP pesquisas intercaladas: em cada volta cada uma desce um nível,
+ * e quando uma acaba o lugar passa logo para a chave seguinte. Os campos são lidos
+ * por offset como em _arena_preorder; inline para os offsets serem constantes
+ * em cada chamada */
+static inline void
+_arena_search_batch(const char *nodes, size_t stride, size_t key_offset, size_t left_offset,
+                    size_t right_offset, idx_t root, const key_t *keys, size_t n, idx_t *out_idx) {
+    idx_t current[SEARCH_GROUP];
+    size_t lane[SEARCH_GROUP];
+    size_t next = 0;
+    int active = 0;
+
+    while (active < SEARCH_GROUP && next < n) {
+        lane[active] = next++;
+        current[active++] = root;
+    }
+
+    while (active > 0) {
+        for (int g = 0; g < active; ) {
+            idx_t c = current[g];
+            key_t key = keys[lane[g]];
+            const char *node = nodes + stride*c;
+
+            if (c == IDX_INVALID || *(const key_t*) (node + key_offset) == key) {
+                out_idx[lane[g]] = c;
+                if (next < n) {
+                    lane[g] = next++;
+                    current[g++] = root;
+                } else {
+                    active--;
+                    lane[g] = lane[active];
+                    current[g] = current[active];
+                }
+                continue;
+            }
+
+            c = *(const idx_t*) (node + ((key < *(const key_t*) (node + key_offset)) ? left_offset : right_offset));
+            if (c != IDX_INVALID) __builtin_prefetch(nodes + stride*c);
+            current[g++] = c;
+        }
     }
-    return tree;
 }
 
-/* Destruir árvore */
+AVLTree
+tree_avl_create(idx_t inicial_capacity) {
+    assert(inicial_capacity > 0);
+
+    AVLTree avl = {NULL, 0, 0, inicial_capacity, IDX_INVALID};
+    avl.nodes = (AVLNode*) malloc( sizeof(AVLNode) * inicial_capacity);
+
+    if (avl.nodes == NULL) {
+        perror("Couldn't allocate AVL tree.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (idx_t i = 0; i < inicial_capacity; i++) {
+        avl.nodes[i] = (AVLNode) {.left = IDX_INVALID, .right = IDX_INVALID, .key = 0, .height = 1};
+    }
+
+    return avl;
+}
+
 void
-tree_rb_destroy(RBTree *rb) {
-    free(rb->nodes);
+tree_avl_destroy(AVLTree* avl) {
+    assert(avl);
+    free(avl->nodes);
 }
 
-/* Aumentar capacidade */
 void
-tree_rb_resize(RBTree *tree) {
-    assert(tree != NULL);
-    uint32_t new_capacity = tree->capacity * RESIZE_FACTOR;
-    
-    RBNode *new_nodes = realloc(tree->nodes, new_capacity * sizeof(RBNode));
-    if (new_nodes == NULL) {
-        free(tree->nodes);
-        perror("Failed to allocate more nodes.");
+tree_avl_resize(AVLTree *avl) {
+    idx_t new_capacity = avl->capacity*RESIZE_FACTOR;
+    if (new_capacity >= IDX_INVALID) {
+        perror("AVL tree exceeded maximum capacity.");
         exit(EXIT_FAILURE);
     }
-    
-    // inicializar novos nós
-    RBNode *endptr = new_nodes + new_capacity;
-    for (RBNode *ptr = new_nodes + tree->capacity; ptr != endptr; ptr++) {
-        ptr->key = 0;
-        ptr->color = -1;
-        ptr->left = IDX_INVALID;
-        ptr->right = IDX_INVALID;
+
+    AVLNode* new_nodes = (AVLNode*) realloc(avl->nodes, sizeof(AVLNode)*new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate enough memory for tree resize.");
+        exit(EXIT_FAILURE);
     }
-    
-    tree->nodes = new_nodes;
-    tree->capacity = new_capacity;
+
+    avl->nodes = new_nodes;        
+    avl->capacity = new_capacity;
 }
 
 
-/* 1 (verdadeiro) se o nó for vermelho */
 static int
-_rb_is_red(RBTree *tree, idx_t i) {
-    // a raiz da arvore é invalida inicialmente
-    // isto significa que vai ser pintada correctamente de preto
-    if (i == IDX_INVALID) return 0; 
-    return (tree->nodes[i].color == RED);
+_avl_get_height(AVLTree* avl, idx_t index) {
+    return (index == IDX_INVALID) ? 0 : avl->nodes[index].height;
 }
 
-/* rotação à esquerda */
-static idx_t
-_rb_rotate_left(RBTree *tree, idx_t h) {
-    g_rotation_count++;
-    idx_t pivot = tree->nodes[h].right;
-    tree->nodes[h].right = tree->nodes[pivot].left;
-    tree->nodes[pivot].left = h;
-    tree->nodes[pivot].color = tree->nodes[h].color;
-    tree->nodes[h].color = RED;
-    return pivot;
+static int
+_avl_get_balance(AVLTree* avl, idx_t index) {
+    if (index == IDX_INVALID) return 0;
+    return _avl_get_height(avl, avl->nodes[index].left) - _avl_get_height(avl, avl->nodes[index].right);
 }
 
-/* rotação à direita */
-static idx_t
-_rb_rotate_right(RBTree *tree, idx_t h) {
-    g_rotation_count++;
-    idx_t pivot = tree->nodes[h].left;
-    tree->nodes[h].left = tree->nodes[pivot].right;
-    tree->nodes[pivot].right = h;
-    tree->nodes[pivot].color = tree->nodes[h].color;
-    tree->nodes[h].color = RED;
-    return pivot;
-}
 
-/* Inverter cores */
 static void
-_rb_flip_colors(RBTree *tree, idx_t h) {
-    tree->nodes[h].color = !tree->nodes[h].color;
-    idx_t left = tree->nodes[h].left;
-    idx_t right = tree->nodes[h].right;
-    if (left != IDX_INVALID)
-        tree->nodes[left].color = !tree->nodes[left].color;
-    if (right != IDX_INVALID)
-        tree->nodes[right].color = !tree->nodes[right].color;
+_avl_update_size(AVLTree *avl, idx_t index) {
+#ifdef TREE_ORDER_STATS
+    AVLNode *nodes = avl->nodes;
+    idx_t left = nodes[index].left, right = nodes[index].right;
+    nodes[index].size = 1 + ((left == IDX_INVALID) ? 0 : nodes[left].size)
+                          + ((right == IDX_INVALID) ? 0 : nodes[right].size);
+#else
+    (void) avl;
+    (void) index;
+#endif
 }
 
-/* Resolve comflictos */
 static idx_t
-_rb_fix_up(RBTree *tree, idx_t h) {
+_avl_rotate_right(AVLTree *avl, idx_t node_idx) {
+    g_rotation_count++;
 
-    /* Caso 1: direita vermelha e esquerda preta -> rotação à esquerda */
-    if (_rb_is_red(tree, tree->nodes[h].right) && !_rb_is_red(tree, tree->nodes[h].left))
-        h = _rb_rotate_left(tree, h);
-    /* Caso 2: filho esquerdo vermelho e neto esquerdo vermelho -> rotação à direita */
-    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[tree->nodes[h].left].left))
-        h = _rb_rotate_right(tree, h);
-    /* Caso 3: ambos os filhos são vermelhos */
-    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[h].right))
-        _rb_flip_colors(tree, h);
+    idx_t pivot = avl->nodes[node_idx].left;
+    idx_t T2 = avl->nodes[pivot].right;
 
-    return h;
+    // Perform rotation:
+    avl->nodes[pivot].right = node_idx;
+    avl->nodes[node_idx].left = T2;
+
+    // Update heights:
+    avl->nodes[node_idx].height = 1 + max(_avl_get_height(avl, avl->nodes[node_idx].left), _avl_get_height(avl, avl->nodes[node_idx].right));
+    avl->nodes[pivot].height = 1 + max(_avl_get_height(avl, avl->nodes[pivot].left), _avl_get_height(avl, avl->nodes[pivot].right));
+    _avl_update_size(avl, node_idx);
+    _avl_update_size(avl, pivot);
+    return pivot;
 }
 
-/* Inserção recursiva: Devolve o novo indice da raiz se inserir */
 static idx_t
-_rb_insert_recursive(RBTree *tree, idx_t h, key_t key) {
+_avl_rotate_left(AVLTree *avl, idx_t x_index) {
+    g_rotation_count++;
 
-    /* Inserir após encontrar nova folha 
-     * (chamada anterior para filho que não existe) */
-    if (h == IDX_INVALID) {
-        idx_t new_index = tree->elements;
-        tree->nodes[new_index].key = key;
-        tree->nodes[new_index].left = IDX_INVALID;
-        tree->nodes[new_index].right = IDX_INVALID;
-        tree->nodes[new_index].color = RED;  // sempre vermelho
-        tree->elements++;
+    idx_t pivot = avl->nodes[x_index].right;
+    idx_t T2 = avl->nodes[pivot].left;
+
+    // Perform rotation:
+    avl->nodes[pivot].left = x_index;
+    avl->nodes[x_index].right = T2;
+
+    // Update heights:
+    avl->nodes[x_index].height = 1 + max(_avl_get_height(avl, avl->nodes[x_index].left), _avl_get_height(avl, avl->nodes[x_index].right));
+    avl->nodes[pivot].height = 1 + max(_avl_get_height(avl, avl->nodes[pivot].left), _avl_get_height(avl, avl->nodes[pivot].right));
+    _avl_update_size(avl, x_index);
+    _avl_update_size(avl, pivot);
+    return pivot;
+}
+
+static idx_t
+_avl_insert_recursive(AVLTree *avl, idx_t node_index, int key) {
+    
+    if (node_index == IDX_INVALID) {
+
+        idx_t new_index = _avl_node_alloc(avl);
+        AVLNode* new_node = &avl->nodes[new_index];
+        new_node->key = key;
+        new_node->left = IDX_INVALID;
+        new_node->right = IDX_INVALID;
+        new_node->height = 1;
+        _avl_update_size(avl, new_index);
         return new_index;
+
     }
     
-    /* Recursão equivalente a binary search tree */
-    if (key < tree->nodes[h].key) {
-        tree->nodes[h].left = _rb_insert_recursive(tree, tree->nodes[h].left, key);
-    } else if (key > tree->nodes[h].key) {
-        tree->nodes[h].right = _rb_insert_recursive(tree, tree->nodes[h].right, key);
+    /* Binary Search Tree */
+    if (key < avl->nodes[node_index].key) {
+        avl->nodes[node_index].left = _avl_insert_recursive(avl, avl->nodes[node_index].left, key);
+    } else if (key > avl->nodes[node_index].key) {
+        avl->nodes[node_index].right = _avl_insert_recursive(avl, avl->nodes[node_index].right, key);
+    } else {
+        return node_index;
     }
+    
+    avl->nodes[node_index].height = 1 + max(_avl_get_height(avl, avl->nodes[node_index].left),
+                                             _avl_get_height(avl, avl->nodes[node_index].right));
+    _avl_update_size(avl, node_index);
 
-    /* É necessário corrigir erros causados pela inserção */
-    h = _rb_fix_up(tree, h);
-    return h;
+    // Get balance factor to check if rebalancing is needed.
+    int balance = _avl_get_balance(avl, node_index);
+
+    /* Left Left */
+    if (balance > 1 && key < avl->nodes[avl->nodes[node_index].left].key)
+        return _avl_rotate_right(avl, node_index);
+
+    /* Right Right */
+    if (balance < -1 && key > avl->nodes[avl->nodes[node_index].right].key)
+        return _avl_rotate_left(avl, node_index);
+
+    /* Left Right */
+    if (balance > 1 && key > avl->nodes[avl->nodes[node_index].left].key) {
+        avl->nodes[node_index].left = _avl_rotate_left(avl, avl->nodes[node_index].left);
+        return _avl_rotate_right(avl, node_index);
+    }
+
+    /* Right Left */
+    if (balance < -1 && key < avl->nodes[avl->nodes[node_index].right].key) {
+        avl->nodes[node_index].right = _avl_rotate_right(avl, avl->nodes[node_index].right);
+        return _avl_rotate_left(avl, node_index);
+    }
+
+    return node_index;
 }
 
-/* Inserir nó */
 void
-tree_rb_insert(RBTree *tree, key_t key) {
+tree_avl_insert(AVLTree *avl, int key) {
 
-    /* Aumentar capacidade  se for necessário */
-    if (tree->capacity == tree->elements)
-        tree_rb_resize(tree);
+    if (avl->free_head == IDX_INVALID && avl->elements == avl->capacity) {
+        tree_avl_resize(avl);
+    }
 
-    tree->tree_root = _rb_insert_recursive(tree, tree->tree_root, key);
-    tree->nodes[tree->tree_root].color = BLACK;
+
+    /* For an empty tree, set the new node as root. */
+    if (avl->elements == 0) {
+        avl->tree_root = _avl_insert_recursive(avl, IDX_INVALID, key);
+    } else {
+        avl->tree_root = _avl_insert_recursive(avl, avl->tree_root, key);
+    }
 }
 
-/* Pesquisa */
-int
-tree_rb_search(RBTree *tree, int key) {
-    RBNode *nodes = tree->nodes;
-    idx_t current = tree->tree_root;
+/* Mesma árvore que tree_avl_insert. A descida fica guardada em path e o
+ * reequilíbrio sobe a partir da folha: pára assim que a altura de um nó não
+ * muda, ou depois da primeira rotação (que devolve a altura antiga à subárvore) */
+void
+tree_avl_insert_iter(AVLTree *avl, key_t key) {
 
-    /* binary search tree search */
+    if (avl->free_head == IDX_INVALID && avl->elements == avl->capacity) {
+        tree_avl_resize(avl);
+    }
+
+    AVLNode *nodes = avl->nodes;
+    idx_t path[TREE_MAX_DEPTH];
+    int depth = 0;
+
+    idx_t current = (avl->elements == 0) ? IDX_INVALID : avl->tree_root;
     while (current != IDX_INVALID) {
-        printf("current = %d\n", current);
-        if (key < nodes[current].key)
-            current = nodes[current].left;
-        else if (key > nodes[current].key)
-            current = nodes[current].right;
+        if (key == nodes[current].key) return;
+        path[depth++] = current;
+        current = (key < nodes[current].key) ? nodes[current].left : nodes[current].right;
+    }
+
+    idx_t new_index = _avl_node_alloc(avl);
+    nodes[new_index] = (AVLNode) {.left = IDX_INVALID, .right = IDX_INVALID, .key = key, .height = 1};
+    _avl_update_size(avl, new_index);
+
+    if (depth == 0) {
+        avl->tree_root = new_index;
+        return;
+    }
+
+    idx_t parent = path[depth-1];
+    if (key < nodes[parent].key) nodes[parent].left = new_index;
+    else nodes[parent].right = new_index;
+
+#ifdef TREE_ORDER_STATS
+    /* a subida pode parar cedo, todo o caminho ganha já o nó novo */
+    for (int d = 0; d < depth; d++) nodes[path[d]].size++;
+#endif
+
+    for (int d = depth - 1; d >= 0; d--) {
+        idx_t node_index = path[d];
+        int height_left = _avl_get_height(avl, nodes[node_index].left);
+        int height_right = _avl_get_height(avl, nodes[node_index].right);
+        int balance = height_left - height_right;
+
+        if (balance >= -1 && balance <= 1) {
+            int height = 1 + max(height_left, height_right);
+            if (height == nodes[node_index].height) return;
+            nodes[node_index].height = height;
+            continue;
+        }
+
+        idx_t subtree;
+        if (balance > 1) {
+            /* Left Right */
+            if (key > nodes[nodes[node_index].left].key)
+                nodes[node_index].left = _avl_rotate_left(avl, nodes[node_index].left);
+            /* Left Left */
+            subtree = _avl_rotate_right(avl, node_index);
+        } else {
+            /* Right Left */
+            if (key < nodes[nodes[node_index].right].key)
+                nodes[node_index].right = _avl_rotate_right(avl, nodes[node_index].right);
+            /* Right Right */
+            subtree = _avl_rotate_left(avl, node_index);
+        }
+
+        if (d == 0) {
+            avl->tree_root = subtree;
+        } else if (nodes[path[d-1]].left == node_index) {
+            nodes[path[d-1]].left = subtree;
+        } else {
+            nodes[path[d-1]].right = subtree;
+        }
+        return;
+    }
+}
+void
+tree_avl_in_order(AVLTree *avl) {
+
+    void _traverse(AVLNode *nodes, idx_t i) {
+        if (i == IDX_INVALID) return;
+        AVLNode no = nodes[i];
+        _traverse(nodes, no.left);
+        printf("%d ", no.key);
+        _traverse(nodes, no.right);
+    }
+
+    _traverse(avl->nodes, avl->tree_root);
+    puts("");
+}
+
+/* Sem recursão, pelo cursor */
+void
+tree_avl_in_order_non(AVLTree *avl) {
+    TreeCursor cur = tree_avl_cursor(avl);
+    for (int ok = tree_cursor_first(&cur); ok; ok = tree_cursor_next(&cur))
+        printf("%d ", tree_cursor_key(&cur));
+    puts("");
+}
+
+
+AVLNode*
+tree_avl_search(AVLTree *avl, int key) {
+    idx_t current_index = avl->tree_root;
+    while (current_index != IDX_INVALID) {
+        if (avl->nodes[current_index].key == key)
+            return &avl->nodes[current_index];
+            
+        else if (key < avl->nodes[current_index].key)
+            current_index = avl->nodes[current_index].left;
+
         else
-            return current;
+            current_index = avl->nodes[current_index].right;
     }
+    return NULL;  // Key not found.
+}
 
-    return -1;
+void
+tree_avl_search_batch(AVLTree *avl, const key_t *keys, size_t n, idx_t *out_idx) {
+    idx_t root = (avl->elements == 0) ? IDX_INVALID : avl->tree_root;
+    _arena_search_batch((const char*) avl->nodes, sizeof(AVLNode), offsetof(AVLNode, key), offsetof(AVLNode, left),
+                        offsetof(AVLNode, right), root, keys, n, out_idx);
 }
 
 
 void
-rb_test_and_log(key_t* arr, FILE *fptr) {
+tree_avl_insert_arr(AVLTree *avl, key_t* arr, size_t size) {
+    assert(avl && arr);
+    for (key_t* endptr = arr+size; arr != endptr && arr != NULL; arr++) {
+        tree_avl_insert(avl, *arr);
+    }
+}
 
-    RBTree vp;
+
+/* Nós já estão por ordem no arena, o do meio é a raiz de cada intervalo.
+ * As subárvores diferem no máximo num nó, logo fica equilibrada sem rotações */
+static idx_t
+_avl_build_range(AVLNode *nodes, idx_t lo, idx_t hi) {
+    if (lo >= hi) return IDX_INVALID;
+
+    idx_t mid = lo + (hi - lo) / 2;
+    idx_t left = _avl_build_range(nodes, lo, mid);
+    idx_t right = _avl_build_range(nodes, mid + 1, hi);
+
+    nodes[mid].left = left;
+    nodes[mid].right = right;
+    nodes[mid].height = 1 + max((left == IDX_INVALID) ? 0 : nodes[left].height,
+                                (right == IDX_INVALID) ? 0 : nodes[right].height);
+#ifdef TREE_ORDER_STATS
+    nodes[mid].size = hi - lo;
+#endif
+    return mid;
+}
+
+AVLTree
+tree_avl_build_sorted(key_t* arr, size_t size) {
+    AVLTree avl = tree_avl_create(size > 10 ? size : 10);
+
+    avl.elements = arr_unique_sorted(arr, size, &avl.nodes[0].key, sizeof(AVLNode));
+    avl.tree_root = _avl_build_range(avl.nodes, 0, avl.elements);
+    return avl;
+}
+
+static idx_t
+_avl_node_alloc(AVLTree *avl) {
+    if (avl->free_head != IDX_INVALID) {
+        idx_t idx = avl->free_head;
+        avl->free_head = avl->nodes[idx].left;
+        return idx;
+    }
+    return avl->elements++;
+}
+
+/* Reequilíbrio pela altura dos filhos: depois de uma remoção já não há a chave
+ * inserida para decidir entre rotação simples e dupla como em _avl_insert_recursive */
+static idx_t
+_avl_rebalance(AVLTree *avl, idx_t node_index) {
+    AVLNode *nodes = avl->nodes;
+    nodes[node_index].height = 1 + max(_avl_get_height(avl, nodes[node_index].left),
+                                       _avl_get_height(avl, nodes[node_index].right));
+    _avl_update_size(avl, node_index);
+    int balance = _avl_get_balance(avl, node_index);
+
+    if (balance > 1) {
+        /* Left Right */
+        if (_avl_get_balance(avl, nodes[node_index].left) < 0)
+            nodes[node_index].left = _avl_rotate_left(avl, nodes[node_index].left);
+        /* Left Left */
+        return _avl_rotate_right(avl, node_index);
+    }
+    if (balance < -1) {
+        /* Right Left */
+        if (_avl_get_balance(avl, nodes[node_index].right) > 0)
+            nodes[node_index].right = _avl_rotate_right(avl, nodes[node_index].right);
+        /* Right Right */
+        return _avl_rotate_left(avl, node_index);
+    }
+    return node_index;
+}
+
+/* Um nó com dois filhos fica com a chave do sucessor e é o sucessor que sai.
+ * removed recebe o slot que deixou a árvore */
+static idx_t
+_avl_delete_recursive(AVLTree *avl, idx_t node_index, key_t key, idx_t *removed) {
+    if (node_index == IDX_INVALID) return IDX_INVALID;
+
+    AVLNode *nodes = avl->nodes;
+    if (key < nodes[node_index].key) {
+        nodes[node_index].left = _avl_delete_recursive(avl, nodes[node_index].left, key, removed);
+    } else if (key > nodes[node_index].key) {
+        nodes[node_index].right = _avl_delete_recursive(avl, nodes[node_index].right, key, removed);
+    } else if (nodes[node_index].left == IDX_INVALID || nodes[node_index].right == IDX_INVALID) {
+        *removed = node_index;
+        return (nodes[node_index].left == IDX_INVALID) ? nodes[node_index].right : nodes[node_index].left;
+    } else {
+        idx_t successor = nodes[node_index].right;
+        while (nodes[successor].left != IDX_INVALID)
+            successor = nodes[successor].left;
+        nodes[node_index].key = nodes[successor].key;
+        nodes[node_index].right = _avl_delete_recursive(avl, nodes[node_index].right, nodes[successor].key, removed);
+    }
+
+    return _avl_rebalance(avl, node_index);
+}
+
+int
+tree_avl_delete(AVLTree *avl, key_t key) {
+    if (avl->elements == 0) return 0;
+
+    idx_t removed = IDX_INVALID;
+    avl->tree_root = _avl_delete_recursive(avl, avl->tree_root, key, &removed);
+    if (removed == IDX_INVALID) return 0;
+
+    avl->nodes[removed].left = avl->free_head;
+    avl->free_head = removed;
+    return 1;
+}
+
+/* Os slots livres desaparecem, a raiz passa a 0 e cada subárvore esquerda fica
+ * logo a seguir ao pai. A capacidade fica nos nós vivos (mínimo 10, como os testes) */
+void
+tree_avl_compact(AVLTree *avl) {
+    idx_t *remap = (idx_t*) malloc(sizeof(idx_t) * (avl->elements + 1));
+    idx_t *order = (idx_t*) malloc(sizeof(idx_t) * (avl->elements + 1));
+    if (remap == NULL || order == NULL) {
+        perror("Failed to allocate compact buffers.");
+        exit(EXIT_FAILURE);
+    }
+
+    idx_t root = (avl->elements == 0) ? IDX_INVALID : avl->tree_root;
+    idx_t live = _arena_preorder((const char*) avl->nodes, sizeof(AVLNode), offsetof(AVLNode, left),
+                                 offsetof(AVLNode, right), root, avl->elements, order, remap);
+    idx_t new_capacity = (live > 10) ? live : 10;
+    AVLNode *new_nodes = (AVLNode*) malloc(sizeof(AVLNode) * new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate compacted AVL tree.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (idx_t i = 0; i < live; i++) {
+        AVLNode node = avl->nodes[order[i]];
+        node.left = (node.left == IDX_INVALID) ? IDX_INVALID : remap[node.left];
+        node.right = (node.right == IDX_INVALID) ? IDX_INVALID : remap[node.right];
+        new_nodes[i] = node;
+    }
+
+    free(avl->nodes);
+    free(remap);
+    free(order);
+    avl->nodes = new_nodes;
+    avl->tree_root = (live == 0) ? IDX_INVALID : 0;
+    avl->elements = live;
+    avl->capacity = new_capacity;
+    avl->free_head = IDX_INVALID;
+}
+
+void
+avl_test_and_log(key_t* arr, FILE *fptr) {
+
+    AVLTree avl;
     clock_t start = 0, end = 0;
     clock_t total = 0;
 
     /* Reset global rotation counter */
     g_rotation_count = 0;
 
-    for (int i = 0; i < g_average; i++) { start = clock();
-        vp = tree_rb_create(g_treesize);
-        for (idx_t idx = 0; idx < g_treesize; idx++)
-            tree_rb_insert(&vp, arr[idx]);
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        avl = tree_avl_create(10);
+        tree_avl_insert_arr(&avl, arr, g_treesize);
         end = clock();
+        perf_stop(&g_perf);
 
         total += (end-start);
-        tree_rb_destroy(&vp);
+        tree_avl_destroy(&avl);
+    }
+
+    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
+    fprintf(fptr, "AVL Tree = %0.4lfms\t(%d rotations)", total_time/g_average, g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, g_average);
+}
+
+/* Red Black Tree Implementation */
+/* Criar arvore */
+RBTree
+tree_rb_create(uint32_t initial_capacity) {
+    RBTree tree;
+    tree.nodes = malloc(initial_capacity * sizeof(RBNode));
+    assert(tree.nodes != NULL);
+
+    tree.elements = 0;
+    tree.capacity = initial_capacity;
+    tree.free_head = IDX_INVALID;
+
+    // a raiz da arvore é invalida inicialmente
+    // para que seja pintada correctamente de preto (caso especial)
+    // e inserida imediatamente
+    tree.tree_root = IDX_INVALID;
+
+    RBNode *endptr = tree.nodes+tree.capacity;
+    for (RBNode *ptr = tree.nodes; ptr != endptr; ptr++) {
+        ptr->key = 0;
+        ptr->color = -1;
+        ptr->left = IDX_INVALID;
+        ptr->right = IDX_INVALID;
+    }
+    return tree;
+}
+
+/* Destruir árvore */
+void
+tree_rb_destroy(RBTree *rb) {
+    free(rb->nodes);
+}
+
+/* Aumentar capacidade */
+void
+tree_rb_resize(RBTree *tree) {
+    assert(tree != NULL);
+    uint32_t new_capacity = tree->capacity * RESIZE_FACTOR;
+    
+    RBNode *new_nodes = realloc(tree->nodes, new_capacity * sizeof(RBNode));
+    if (new_nodes == NULL) {
+        free(tree->nodes);
+        perror("Failed to allocate more nodes.");
+        exit(EXIT_FAILURE);
+    }
+    
+    // inicializar novos nós
+    RBNode *endptr = new_nodes + new_capacity;
+    for (RBNode *ptr = new_nodes + tree->capacity; ptr != endptr; ptr++) {
+        ptr->key = 0;
+        ptr->color = -1;
+        ptr->left = IDX_INVALID;
+        ptr->right = IDX_INVALID;
+    }
+    
+    tree->nodes = new_nodes;
+    tree->capacity = new_capacity;
+}
+
+
+/* 1 (verdadeiro) se o nó for vermelho */
+static int
+_rb_is_red(RBTree *tree, idx_t i) {
+    // a raiz da arvore é invalida inicialmente
+    // isto significa que vai ser pintada correctamente de preto
+    if (i == IDX_INVALID) return 0; 
+    return (tree->nodes[i].color == RED);
+}
+
+static void
+_rb_update_size(RBTree *tree, idx_t i) {
+#ifdef TREE_ORDER_STATS
+    RBNode *nodes = tree->nodes;
+    idx_t left = nodes[i].left, right = nodes[i].right;
+    nodes[i].size = 1 + ((left == IDX_INVALID) ? 0 : nodes[left].size)
+                      + ((right == IDX_INVALID) ? 0 : nodes[right].size);
+#else
+    (void) tree;
+    (void) i;
+#endif
+}
+
+/* rotação à esquerda */
+static idx_t
+_rb_rotate_left(RBTree *tree, idx_t h) {
+    g_rotation_count++;
+    idx_t pivot = tree->nodes[h].right;
+    tree->nodes[h].right = tree->nodes[pivot].left;
+    tree->nodes[pivot].left = h;
+    tree->nodes[pivot].color = tree->nodes[h].color;
+    tree->nodes[h].color = RED;
+    _rb_update_size(tree, h);
+    _rb_update_size(tree, pivot);
+    return pivot;
+}
+
+/* rotação à direita */
+static idx_t
+_rb_rotate_right(RBTree *tree, idx_t h) {
+    g_rotation_count++;
+    idx_t pivot = tree->nodes[h].left;
+    tree->nodes[h].left = tree->nodes[pivot].right;
+    tree->nodes[pivot].right = h;
+    tree->nodes[pivot].color = tree->nodes[h].color;
+    tree->nodes[h].color = RED;
+    _rb_update_size(tree, h);
+    _rb_update_size(tree, pivot);
+    return pivot;
+}
+
+/* Inverter cores */
+static void
+_rb_flip_colors(RBTree *tree, idx_t h) {
+    tree->nodes[h].color = !tree->nodes[h].color;
+    idx_t left = tree->nodes[h].left;
+    idx_t right = tree->nodes[h].right;
+    if (left != IDX_INVALID)
+        tree->nodes[left].color = !tree->nodes[left].color;
+    if (right != IDX_INVALID)
+        tree->nodes[right].color = !tree->nodes[right].color;
+}
+
+/* Resolve comflictos. Também é o ponto em que a subida da inserção e da
+ * remoção passa por cada nó, por isso acerta aqui o tamanho */
+static idx_t
+_rb_fix_up(RBTree *tree, idx_t h) {
+    _rb_update_size(tree, h);
+
+    /* Caso 1: direita vermelha e esquerda preta -> rotação à esquerda */
+    if (_rb_is_red(tree, tree->nodes[h].right) && !_rb_is_red(tree, tree->nodes[h].left))
+        h = _rb_rotate_left(tree, h);
+    /* Caso 2: filho esquerdo vermelho e neto esquerdo vermelho -> rotação à direita */
+    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[tree->nodes[h].left].left))
+        h = _rb_rotate_right(tree, h);
+    /* Caso 3: ambos os filhos são vermelhos */
+    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[h].right))
+        _rb_flip_colors(tree, h);
+
+    return h;
+}
+
+/* Igual a _rb_fix_up, mas diz se mexeu em alguma coisa */
+static idx_t
+_rb_fix_up_tracked(RBTree *tree, idx_t h, int *changed) {
+
+    *changed = 0;
+    if (_rb_is_red(tree, tree->nodes[h].right) && !_rb_is_red(tree, tree->nodes[h].left)) {
+        h = _rb_rotate_left(tree, h);
+        *changed = 1;
+    }
+    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[tree->nodes[h].left].left)) {
+        h = _rb_rotate_right(tree, h);
+        *changed = 1;
+    }
+    if (_rb_is_red(tree, tree->nodes[h].left) && _rb_is_red(tree, tree->nodes[h].right)) {
+        _rb_flip_colors(tree, h);
+        *changed = 1;
+    }
+
+    return h;
+}
+
+/* Inserção recursiva: Devolve o novo indice da raiz se inserir */
+static idx_t
+_rb_insert_recursive(RBTree *tree, idx_t h, key_t key) {
+
+    /* Inserir após encontrar nova folha 
+     * (chamada anterior para filho que não existe) */
+    if (h == IDX_INVALID) {
+        idx_t new_index = _rb_node_alloc(tree);
+        tree->nodes[new_index].key = key;
+        tree->nodes[new_index].left = IDX_INVALID;
+        tree->nodes[new_index].right = IDX_INVALID;
+        tree->nodes[new_index].color = RED;  // sempre vermelho
+        _rb_update_size(tree, new_index);
+        return new_index;
+    }
+    
+    /* Recursão equivalente a binary search tree */
+    if (key < tree->nodes[h].key) {
+        tree->nodes[h].left = _rb_insert_recursive(tree, tree->nodes[h].left, key);
+    } else if (key > tree->nodes[h].key) {
+        tree->nodes[h].right = _rb_insert_recursive(tree, tree->nodes[h].right, key);
+    }
+
+    /* É necessário corrigir erros causados pela inserção */
+    h = _rb_fix_up(tree, h);
+    return h;
+}
+
+/* Inserir nó */
+void
+tree_rb_insert(RBTree *tree, key_t key) {
+
+    /* Aumentar capacidade  se for necessário */
+    if (tree->free_head == IDX_INVALID && tree->capacity == tree->elements)
+        tree_rb_resize(tree);
+
+    tree->tree_root = _rb_insert_recursive(tree, tree->tree_root, key);
+    tree->nodes[tree->tree_root].color = BLACK;
+}
+
+/* Mesma árvore que tree_rb_insert, sem recursão. O _rb_fix_up de um nó só olha
+ * para a cor dos filhos e do neto esquerdo, por isso quando um nó preto fica
+ * igual nada acima dele pode mudar e a subida pára aí */
+void
+tree_rb_insert_iter(RBTree *tree, key_t key) {
+
+    if (tree->free_head == IDX_INVALID && tree->capacity == tree->elements)
+        tree_rb_resize(tree);
+
+    RBNode *nodes = tree->nodes;
+    idx_t path[TREE_MAX_DEPTH];
+    int depth = 0;
+
+    idx_t current = tree->tree_root;
+    while (current != IDX_INVALID) {
+        if (key == nodes[current].key) return;
+        path[depth++] = current;
+        current = (key < nodes[current].key) ? nodes[current].left : nodes[current].right;
+    }
+
+    idx_t new_index = _rb_node_alloc(tree);
+    nodes[new_index].key = key;
+    nodes[new_index].left = IDX_INVALID;
+    nodes[new_index].right = IDX_INVALID;
+    nodes[new_index].color = RED;
+    _rb_update_size(tree, new_index);
+
+#ifdef TREE_ORDER_STATS
+    /* a subida pode parar cedo, todo o caminho ganha já o nó novo */
+    for (int p = 0; p < depth; p++) nodes[path[p]].size++;
+#endif
+
+    idx_t child = new_index;
+    int d = depth - 1;
+    for (; d >= 0; d--) {
+        idx_t h = path[d];
+        if (key < nodes[h].key) nodes[h].left = child;
+        else nodes[h].right = child;
+
+        int changed;
+        child = _rb_fix_up_tracked(tree, h, &changed);
+        if (!changed && nodes[child].color == BLACK) break;
+    }
+
+    /* subiu até ao fim, a raiz pode ter mudado */
+    if (d < 0) tree->tree_root = child;
+    tree->nodes[tree->tree_root].color = BLACK;
+}
+
+/* Pesquisa */
+int
+tree_rb_search(RBTree *tree, int key) {
+    RBNode *nodes = tree->nodes;
+    idx_t current = tree->tree_root;
+
+    /* binary search tree search */
+    while (current != IDX_INVALID) {
+        if (key < nodes[current].key)
+            current = nodes[current].left;
+        else if (key > nodes[current].key)
+            current = nodes[current].right;
+        else
+            return current;
+    }
+
+    return -1;
+}
+
+void
+tree_rb_search_batch(RBTree *tree, const key_t *keys, size_t n, idx_t *out_idx) {
+    _arena_search_batch((const char*) tree->nodes, sizeof(RBNode), offsetof(RBNode, key), offsetof(RBNode, left),
+                        offsetof(RBNode, right), tree->tree_root, keys, n, out_idx);
+}
+
+
+/* Constrói uma árvore 2-3 com todas as folhas à mesma altura e escreve-a como LLRB:
+ * um nó-2 é um nó preto, um nó-3 é um nó preto com um filho vermelho à esquerda.
+ * child_cap = 3^(black_height-1) - 1 é o máximo de chaves que cabe em cada filho,
+ * se o intervalo não couber em dois filhos a raiz passa a nó-3 */
+static idx_t
+_rb_build_range(RBNode *nodes, idx_t lo, idx_t hi, int black_height, uint64_t child_cap) {
+    if (black_height == 0) return IDX_INVALID;
+
+    idx_t n = hi - lo;
+    uint64_t next_cap = (black_height > 1) ? (child_cap + 1) / 3 - 1 : 0;
+
+    /* nó-2 */
+    if (n <= 2*child_cap + 1) {
+        idx_t mid = lo + (n - 1) / 2;
+        nodes[mid].left = _rb_build_range(nodes, lo, mid, black_height - 1, next_cap);
+        nodes[mid].right = _rb_build_range(nodes, mid + 1, hi, black_height - 1, next_cap);
+        nodes[mid].color = BLACK;
+#ifdef TREE_ORDER_STATS
+        nodes[mid].size = n;
+#endif
+        return mid;
+    }
+
+    /* nó-3: as n-2 chaves restantes divididas por três filhos */
+    idx_t part = (n - 2) / 3;
+    idx_t extra = (n - 2) % 3;
+    idx_t red = lo + part + (extra > 0);
+    idx_t black = red + 1 + part + (extra > 1);
+
+    nodes[red].left = _rb_build_range(nodes, lo, red, black_height - 1, next_cap);
+    nodes[red].right = _rb_build_range(nodes, red + 1, black, black_height - 1, next_cap);
+    nodes[red].color = RED;
+#ifdef TREE_ORDER_STATS
+    nodes[red].size = black - lo;
+#endif
+
+    nodes[black].left = red;
+    nodes[black].right = _rb_build_range(nodes, black + 1, hi, black_height - 1, next_cap);
+    nodes[black].color = BLACK;
+#ifdef TREE_ORDER_STATS
+    nodes[black].size = n;
+#endif
+    return black;
+}
+
+RBTree
+tree_rb_build_sorted(key_t* arr, size_t size) {
+    RBTree tree = tree_rb_create(size > 10 ? size : 10);
+
+    tree.elements = arr_unique_sorted(arr, size, &tree.nodes[0].key, sizeof(RBNode));
+
+    /* altura preta floor(log2(n+1)): n >= 2^bh - 1 e n <= 3^bh - 1 */
+    int black_height = 0;
+    uint64_t child_cap = 0;
+    while (((uint64_t) 2 << black_height) - 1 <= tree.elements) {
+        child_cap = (black_height == 0) ? 0 : 3*child_cap + 2;
+        black_height++;
+    }
+
+    tree.tree_root = _rb_build_range(tree.nodes, 0, tree.elements, black_height, child_cap);
+    return tree;
+}
+
+static idx_t
+_rb_node_alloc(RBTree *tree) {
+    if (tree->free_head != IDX_INVALID) {
+        idx_t idx = tree->free_head;
+        tree->free_head = tree->nodes[idx].left;
+        return idx;
+    }
+    return tree->elements++;
+}
+
+/* Remoção LLRB (Sedgewick): na descida empurra-se um vermelho para o lado por
+ * onde se vai, para que o nó a tirar nunca seja um nó-2, e na subida o
+ * _rb_fix_up desfaz o que ficou torto */
+static idx_t
+_rb_move_red_left(RBTree *tree, idx_t h) {
+    _rb_flip_colors(tree, h);
+    idx_t right = tree->nodes[h].right;
+    if (right != IDX_INVALID && _rb_is_red(tree, tree->nodes[right].left)) {
+        tree->nodes[h].right = _rb_rotate_right(tree, right);
+        h = _rb_rotate_left(tree, h);
+        _rb_flip_colors(tree, h);
+    }
+    return h;
+}
+
+static idx_t
+_rb_move_red_right(RBTree *tree, idx_t h) {
+    _rb_flip_colors(tree, h);
+    idx_t left = tree->nodes[h].left;
+    if (left != IDX_INVALID && _rb_is_red(tree, tree->nodes[left].left)) {
+        h = _rb_rotate_right(tree, h);
+        _rb_flip_colors(tree, h);
+    }
+    return h;
+}
+
+static idx_t
+_rb_delete_min(RBTree *tree, idx_t h, idx_t *removed) {
+    RBNode *nodes = tree->nodes;
+    if (nodes[h].left == IDX_INVALID) {
+        *removed = h;
+        return IDX_INVALID;
+    }
+
+    if (!_rb_is_red(tree, nodes[h].left) && !_rb_is_red(tree, nodes[nodes[h].left].left))
+        h = _rb_move_red_left(tree, h);
+
+    nodes[h].left = _rb_delete_min(tree, nodes[h].left, removed);
+    return _rb_fix_up(tree, h);
+}
+
+/* Só é chamada com uma chave que existe */
+static idx_t
+_rb_delete_recursive(RBTree *tree, idx_t h, key_t key, idx_t *removed) {
+    RBNode *nodes = tree->nodes;
+
+    if (key < nodes[h].key) {
+        if (!_rb_is_red(tree, nodes[h].left) && !_rb_is_red(tree, nodes[nodes[h].left].left))
+            h = _rb_move_red_left(tree, h);
+        nodes[h].left = _rb_delete_recursive(tree, nodes[h].left, key, removed);
+    } else {
+        if (_rb_is_red(tree, nodes[h].left))
+            h = _rb_rotate_right(tree, h);
+
+        if (key == nodes[h].key && nodes[h].right == IDX_INVALID) {
+            *removed = h;
+            return IDX_INVALID;
+        }
+
+        idx_t right = nodes[h].right;
+        if (!_rb_is_red(tree, right) && !_rb_is_red(tree, nodes[right].left))
+            h = _rb_move_red_right(tree, h);
+
+        if (key == nodes[h].key) {
+            idx_t successor = nodes[h].right;
+            while (nodes[successor].left != IDX_INVALID)
+                successor = nodes[successor].left;
+            nodes[h].key = nodes[successor].key;
+            nodes[h].right = _rb_delete_min(tree, nodes[h].right, removed);
+        } else {
+            nodes[h].right = _rb_delete_recursive(tree, nodes[h].right, key, removed);
+        }
+    }
+
+    return _rb_fix_up(tree, h);
+}
+
+int
+tree_rb_delete(RBTree *tree, key_t key) {
+    if (tree->tree_root == IDX_INVALID || tree_rb_search(tree, key) == -1) return 0;
+
+    RBNode *nodes = tree->nodes;
+    idx_t root = tree->tree_root;
+    if (!_rb_is_red(tree, nodes[root].left) && !_rb_is_red(tree, nodes[root].right))
+        nodes[root].color = RED;
+
+    idx_t removed = IDX_INVALID;
+    tree->tree_root = _rb_delete_recursive(tree, root, key, &removed);
+    if (tree->tree_root != IDX_INVALID)
+        nodes[tree->tree_root].color = BLACK;
+
+    nodes[removed].left = tree->free_head;
+    tree->free_head = removed;
+    return 1;
+}
+
+/* Como tree_avl_compact */
+void
+tree_rb_compact(RBTree *tree) {
+    idx_t *remap = (idx_t*) malloc(sizeof(idx_t) * (tree->elements + 1));
+    idx_t *order = (idx_t*) malloc(sizeof(idx_t) * (tree->elements + 1));
+    if (remap == NULL || order == NULL) {
+        perror("Failed to allocate compact buffers.");
+        exit(EXIT_FAILURE);
+    }
+
+    idx_t live = _arena_preorder((const char*) tree->nodes, sizeof(RBNode), offsetof(RBNode, left),
+                                 offsetof(RBNode, right), tree->tree_root, tree->elements, order, remap);
+    idx_t new_capacity = (live > 10) ? live : 10;
+    RBNode *new_nodes = (RBNode*) malloc(sizeof(RBNode) * new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate compacted Red-Black tree.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (idx_t i = 0; i < live; i++) {
+        RBNode node = tree->nodes[order[i]];
+        node.left = (node.left == IDX_INVALID) ? IDX_INVALID : remap[node.left];
+        node.right = (node.right == IDX_INVALID) ? IDX_INVALID : remap[node.right];
+        new_nodes[i] = node;
+    }
+
+    free(tree->nodes);
+    free(remap);
+    free(order);
+    tree->nodes = new_nodes;
+    tree->tree_root = (live == 0) ? IDX_INVALID : 0;
+    tree->elements = live;
+    tree->capacity = new_capacity;
+    tree->free_head = IDX_INVALID;
+}
+
+void
+rb_test_and_log(key_t* arr, FILE *fptr) {
+
+    RBTree vp;
+    clock_t start = 0, end = 0;
+    clock_t total = 0;
+
+    /* Reset global rotation counter */
+    g_rotation_count = 0;
+
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        vp = tree_rb_create(g_treesize);
+        for (idx_t idx = 0; idx < g_treesize; idx++)
+            tree_rb_insert(&vp, arr[idx]);
+        end = clock();
+        perf_stop(&g_perf);
+
+        total += (end-start);
+        tree_rb_destroy(&vp);
+    }
+
+    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
+    fprintf(fptr, "RB Tree = %0.4lfms\t(%d rotations)", total_time/g_average, g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, g_average);
+}
+
+/* Treap Functions */
+Treap
+tree_treap_create(idx_t initial_capacity) {
+    Treap new_treap;
+    new_treap.nodes = (TreapNode*) malloc(sizeof(TreapNode) * initial_capacity);
+    if (new_treap.nodes == NULL) {
+        perror("Failed to allocate Treap.");
+        exit(EXIT_FAILURE);
+    }
+
+    new_treap.tree_root = IDX_INVALID;
+    new_treap.elements = 0;
+    new_treap.capacity = initial_capacity;
+    new_treap.free_head = IDX_INVALID;
+
+    /* inicializar novos nós */
+    TreapNode* endptr = new_treap.nodes + initial_capacity;
+    for (TreapNode *ptr = new_treap.nodes; ptr != endptr; ptr++) {
+        *ptr = (TreapNode){.key = 0, .priority = 0, .left = IDX_INVALID, .right = IDX_INVALID};
+    }
+
+    return new_treap;
+}
+
+void tree_treap_resize(Treap *treap) {
+    /* se a capacity for máxima */
+    if (treap->capacity == IDX_INVALID - 1) return;
+
+    idx_t old_capacity = treap->capacity;
+    idx_t new_capacity = (idx_t)(treap->capacity * RESIZE_FACTOR);
+
+    /* se a nova capacity for maior que a capacidade máxima */
+    if (new_capacity < treap->capacity) {
+        new_capacity = IDX_INVALID - 1; 
+    }
+
+    TreapNode *new_nodes = (TreapNode*) realloc(treap->nodes, sizeof(TreapNode) * new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to realloc new nodes.");
+        exit(EXIT_FAILURE);
+    }
+    treap->nodes = new_nodes;
+
+    /* incializar nova memóra */
+    for (idx_t i = old_capacity; i < new_capacity; i++) {
+        treap->nodes[i] = (TreapNode){.key = 0, .priority = 0, .left = IDX_INVALID, .right = IDX_INVALID};
+    }
+
+    treap->capacity = new_capacity;
+}
+
+void
+tree_treap_destroy(Treap *treap) {
+    free(treap->nodes);
+    treap->capacity = 0;
+    treap->elements = 0;
+}
+
+
+static void
+_treap_update_size(Treap *treap, idx_t idx) {
+#ifdef TREE_ORDER_STATS
+    TreapNode *nodes = treap->nodes;
+    idx_t left = nodes[idx].left, right = nodes[idx].right;
+    nodes[idx].size = 1 + ((left == IDX_INVALID) ? 0 : nodes[left].size)
+                        + ((right == IDX_INVALID) ? 0 : nodes[right].size);
+#else
+    (void) treap;
+    (void) idx;
+#endif
+}
+
+static idx_t
+_treap_rotate_right(Treap *treap, idx_t no_idx) {
+    g_rotation_count++;
+
+    TreapNode *nodes = treap->nodes;
+    idx_t pivot_idx = nodes[no_idx].left;
+
+    /* à esquerda agora fica a subtree do pivot */ 
+    nodes[no_idx].left = nodes[pivot_idx].right;
+    /* à direita do pivot fica o nó atual */ 
+    nodes[pivot_idx].right = no_idx;
+    _treap_update_size(treap, no_idx);
+    _treap_update_size(treap, pivot_idx);
+
+    /* o pivot não muda de sitio mas pode passar a ser a nova raiz */
+    return pivot_idx;
+}
+
+static idx_t 
+_treap_rotate_left(Treap *treap, idx_t no_idx) {
+    g_rotation_count++;
+
+    TreapNode *nodes = treap->nodes;
+    idx_t pivot_idx = nodes[no_idx].right;
+
+    /* subtree do pivot */ 
+    nodes[no_idx].right = nodes[pivot_idx].left;
+    /* o pivot agora leva ao nó */ 
+    nodes[pivot_idx].left = no_idx;
+    _treap_update_size(treap, no_idx);
+    _treap_update_size(treap, pivot_idx);
+
+    /* o pivot pode passar a ser a nova raiz */
+    return pivot_idx;
+}
+
+static idx_t
+_treap_insert_recursive(Treap *treap, idx_t idx, key_t key) {
+    TreapNode *nodes = treap->nodes;
+
+    /* Criamos um novo nó quando quando o idx é inválido,
+     * ou seja, quando o BST tenta inserir numa folha
+     * depois devolvemos o novo indice à chamada anterior desta função*/
+    if (idx == IDX_INVALID) {
+        idx_t new_index = _treap_node_alloc(treap);
+        nodes[new_index] = (TreapNode){
+            .key = key,
+            .priority = (idx_t)rand_idx(1, IDX_INVALID - 1),
+            .left = IDX_INVALID,
+            .right = IDX_INVALID
+        };
+        _treap_update_size(treap, new_index);
+        return new_index;
+    }
+
+    /* inserir tipo binary search tree */
+    if (key < nodes[idx].key) {
+        nodes[idx].left = _treap_insert_recursive(treap, nodes[idx].left, key);
+        _treap_update_size(treap, idx);
+
+        /* manter max heap */
+        if (nodes[nodes[idx].left].priority > nodes[idx].priority) {
+            idx = _treap_rotate_right(treap, idx);
+        }
+
+    } else if (key > nodes[idx].key) {
+        nodes[idx].right = _treap_insert_recursive(treap, nodes[idx].right, key);
+        _treap_update_size(treap, idx);
+
+        /* manter max heap */
+        if (nodes[nodes[idx].right].priority > nodes[idx].priority) {
+            idx = _treap_rotate_left(treap, idx);
+        }
+
+    }
+
+    return idx;
+}
+
+/* inserir nó */
+void
+tree_treap_insert(Treap *treap, key_t key) {
+    if (treap->free_head == IDX_INVALID && treap->capacity == treap->elements)
+        tree_treap_resize(treap);
+
+    treap->tree_root = _treap_insert_recursive(treap, treap->tree_root, key);
+}
+
+/* Mesma árvore que tree_treap_insert (gasta o mesmo número do gerador).
+ * Insere como folha e sobe com rotações enquanto a prioridade for maior que a do pai */
+void
+tree_treap_insert_iter(Treap *treap, key_t key) {
+    if (treap->free_head == IDX_INVALID && treap->capacity == treap->elements)
+        tree_treap_resize(treap);
+
+    TreapNode *nodes = treap->nodes;
+    idx_t path[TREE_MAX_DEPTH];
+    int depth = 0;
+
+    idx_t current = treap->tree_root;
+    while (current != IDX_INVALID) {
+        if (key == nodes[current].key) return;
+        if (depth == TREE_MAX_DEPTH) {
+            treap->tree_root = _treap_insert_recursive(treap, treap->tree_root, key);
+            return;
+        }
+        path[depth++] = current;
+        current = (key < nodes[current].key) ? nodes[current].left : nodes[current].right;
+    }
+
+    idx_t new_index = _treap_node_alloc(treap);
+    nodes[new_index] = (TreapNode){
+        .key = key,
+        .priority = (idx_t)rand_idx(1, IDX_INVALID - 1),
+        .left = IDX_INVALID,
+        .right = IDX_INVALID
+    };
+    _treap_update_size(treap, new_index);
+
+#ifdef TREE_ORDER_STATS
+    /* a subida pára no primeiro pai com prioridade maior, todo o caminho ganha já o nó novo */
+    for (int p = 0; p < depth; p++) nodes[path[p]].size++;
+#endif
+
+    idx_t child = new_index;
+    int d = depth - 1;
+    for (; d >= 0; d--) {
+        idx_t parent = path[d];
+        if (key < nodes[parent].key) {
+            nodes[parent].left = child;
+            if (nodes[child].priority <= nodes[parent].priority) break;
+            child = _treap_rotate_right(treap, parent);
+        } else {
+            nodes[parent].right = child;
+            if (nodes[child].priority <= nodes[parent].priority) break;
+            child = _treap_rotate_left(treap, parent);
+        }
+    }
+
+    if (d < 0) treap->tree_root = child;
+}
+
+idx_t
+tree_treap_search(Treap *treap, key_t key) {
+    TreapNode *nodes = treap->nodes;
+    idx_t current = treap->tree_root;
+
+    while (current != IDX_INVALID && nodes[current].key != key)
+        current = (key < nodes[current].key) ? nodes[current].left : nodes[current].right;
+
+    return current;
+}
+
+void
+tree_treap_search_batch(Treap *treap, const key_t *keys, size_t n, idx_t *out_idx) {
+    _arena_search_batch((const char*) treap->nodes, sizeof(TreapNode), offsetof(TreapNode, key), offsetof(TreapNode, left),
+                        offsetof(TreapNode, right), treap->tree_root, keys, n, out_idx);
+}
+
+/* Árvore cartesiana com uma pilha: cada nó novo fica à direita do último nó da pilha
+ * com prioridade maior ou igual, e o que sair da pilha passa a ser o seu filho esquerdo */
+Treap
+tree_treap_build_sorted(key_t* arr, size_t size) {
+    Treap treap = tree_treap_create(size > 10 ? size : 10);
+    TreapNode *nodes = treap.nodes;
+
+    treap.elements = arr_unique_sorted(arr, size, &nodes[0].key, sizeof(TreapNode));
+    if (treap.elements == 0) return treap;
+
+    idx_t *stack = (idx_t*) malloc(sizeof(idx_t) * treap.elements);
+    if (stack == NULL) {
+        perror("Failed to allocate Treap build stack.");
+        exit(EXIT_FAILURE);
+    }
+
+    idx_t top = 0;
+    for (idx_t i = 0; i < treap.elements; i++) {
+        nodes[i].priority = rand_idx(1, IDX_INVALID - 1);
+
+        idx_t last = IDX_INVALID;
+        while (top > 0 && nodes[stack[top-1]].priority < nodes[i].priority) {
+            last = stack[--top];
+            /* quem sai da pilha já tem a subárvore completa */
+            _treap_update_size(&treap, last);
+        }
+        nodes[i].left = last;
+        nodes[i].right = IDX_INVALID;
+        if (top > 0) nodes[stack[top-1]].right = i;
+        stack[top++] = i;
+    }
+
+    while (top > 0) _treap_update_size(&treap, stack[--top]);
+    treap.tree_root = stack[0];
+    free(stack);
+    return treap;
+}
+
+static idx_t
+_treap_node_alloc(Treap *treap) {
+    if (treap->free_head != IDX_INVALID) {
+        idx_t idx = treap->free_head;
+        treap->free_head = treap->nodes[idx].left;
+        return idx;
+    }
+    return treap->elements++;
+}
+
+/* O nó a apagar desce por rotações, subindo sempre o filho de maior prioridade
+ * para manter o max heap, até ter no máximo um filho e poder sair */
+static idx_t
+_treap_delete_recursive(Treap *treap, idx_t idx, key_t key, idx_t *removed) {
+    if (idx == IDX_INVALID) return IDX_INVALID;
+
+    TreapNode *nodes = treap->nodes;
+    if (key < nodes[idx].key) {
+        nodes[idx].left = _treap_delete_recursive(treap, nodes[idx].left, key, removed);
+        _treap_update_size(treap, idx);
+        return idx;
+    }
+    if (key > nodes[idx].key) {
+        nodes[idx].right = _treap_delete_recursive(treap, nodes[idx].right, key, removed);
+        _treap_update_size(treap, idx);
+        return idx;
+    }
+
+    if (nodes[idx].left == IDX_INVALID) {
+        *removed = idx;
+        return nodes[idx].right;
+    }
+    if (nodes[idx].right == IDX_INVALID) {
+        *removed = idx;
+        return nodes[idx].left;
+    }
+
+    if (nodes[nodes[idx].left].priority > nodes[nodes[idx].right].priority) {
+        idx = _treap_rotate_right(treap, idx);
+        nodes[idx].right = _treap_delete_recursive(treap, nodes[idx].right, key, removed);
+    } else {
+        idx = _treap_rotate_left(treap, idx);
+        nodes[idx].left = _treap_delete_recursive(treap, nodes[idx].left, key, removed);
+    }
+    _treap_update_size(treap, idx);
+    return idx;
+}
+
+int
+tree_treap_delete(Treap *treap, key_t key) {
+    idx_t removed = IDX_INVALID;
+    treap->tree_root = _treap_delete_recursive(treap, treap->tree_root, key, &removed);
+    if (removed == IDX_INVALID) return 0;
+
+    treap->nodes[removed].left = treap->free_head;
+    treap->free_head = removed;
+    return 1;
+}
+
+/* Como tree_avl_compact */
+void
+tree_treap_compact(Treap *treap) {
+    idx_t *remap = (idx_t*) malloc(sizeof(idx_t) * (treap->elements + 1));
+    idx_t *order = (idx_t*) malloc(sizeof(idx_t) * (treap->elements + 1));
+    if (remap == NULL || order == NULL) {
+        perror("Failed to allocate compact buffers.");
+        exit(EXIT_FAILURE);
+    }
+
+    idx_t live = _arena_preorder((const char*) treap->nodes, sizeof(TreapNode), offsetof(TreapNode, left),
+                                 offsetof(TreapNode, right), treap->tree_root, treap->elements, order, remap);
+    idx_t new_capacity = (live > 10) ? live : 10;
+    TreapNode *new_nodes = (TreapNode*) malloc(sizeof(TreapNode) * new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate compacted Treap.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (idx_t i = 0; i < live; i++) {
+        TreapNode node = treap->nodes[order[i]];
+        node.left = (node.left == IDX_INVALID) ? IDX_INVALID : remap[node.left];
+        node.right = (node.right == IDX_INVALID) ? IDX_INVALID : remap[node.right];
+        new_nodes[i] = node;
+    }
+
+    free(treap->nodes);
+    free(remap);
+    free(order);
+    treap->nodes = new_nodes;
+    treap->tree_root = (live == 0) ? IDX_INVALID : 0;
+    treap->elements = live;
+    treap->capacity = new_capacity;
+    treap->free_head = IDX_INVALID;
+}
+
+void
+tree_treap_visualize(Treap *treap, idx_t root, int depth, const char *prefix, int is_left) {
+    if (root == IDX_INVALID) return;
+
+    TreapNode *node = &treap->nodes[root];
+
+    // Print current node
+    printf("%s", prefix);
+    printf("%s", (depth == 0) ? "" : (is_left ? "├── " : "└── "));
+    printf("(%d, p=%u)\n", node->key, node->priority);
+
+    // Prepare prefix for child nodes
+    char new_prefix[256];
+    snprintf(new_prefix, sizeof(new_prefix), "%s%s", prefix, (depth == 0) ? "" : (is_left ? "│   " : "    "));
+
+    // Right child (printed first for better tree shape)
+    tree_treap_visualize(treap, node->right, depth + 1, new_prefix, 1);
+
+    // Left child
+    tree_treap_visualize(treap, node->left, depth + 1, new_prefix, 0);
+}
+
+void
+treap_test_and_log(key_t* arr, FILE *fptr) {
+
+    Treap treap;
+    clock_t start = 0, end = 0;
+    clock_t total = 0;
+
+    /* Reset global rotation counter */
+    g_rotation_count = 0;
+
+
+    perf_clear(&g_perf);
+    for (int i = 0; i < 1; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        treap = tree_treap_create(g_treesize);
+        for (idx_t idx = 0; idx < g_treesize; idx++)
+            tree_treap_insert(&treap, arr[idx]);
+        end = clock();
+        perf_stop(&g_perf);
+
+        total += (end-start);
+        tree_treap_destroy(&treap);
+    }
+
+    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
+    fprintf(fptr, "TREAP = %0.4lfms\t(%d rotations)", total_time/g_average, g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, 1);
+}
+
+/* ===== PACKED AVL / RB ===== */
+
+static inline idx_t
+_avlp_left(const AVLPackedNode *node) {
+    idx_t left = node->left_balance & AVL_PACKED_IDX_MASK;
+    return (left == AVL_PACKED_IDX_MASK) ? IDX_INVALID : left;
+}
+
+static inline void
+_avlp_set_left(AVLPackedNode *node, idx_t left) {
+    node->left_balance = (node->left_balance & ~AVL_PACKED_IDX_MASK) | (left & AVL_PACKED_IDX_MASK);
+}
+
+/* altura esquerda - altura direita, como _avl_get_balance */
+static inline int
+_avlp_balance(const AVLPackedNode *node) {
+    return (int) (node->left_balance >> 30) - 1;
+}
+
+static inline void
+_avlp_set_balance(AVLPackedNode *node, int balance) {
+    node->left_balance = (node->left_balance & AVL_PACKED_IDX_MASK) | ((idx_t) (balance + 1) << 30);
+}
+
+AVLPackedTree
+tree_avl_packed_create(idx_t initial_capacity) {
+    assert(initial_capacity > 0);
+
+    AVLPackedTree avl = {NULL, IDX_INVALID, 0, initial_capacity};
+    avl.nodes = (AVLPackedNode*) malloc(sizeof(AVLPackedNode) * initial_capacity);
+
+    if (avl.nodes == NULL) {
+        perror("Couldn't allocate packed AVL tree.");
+        exit(EXIT_FAILURE);
+    }
+    return avl;
+}
+
+void
+tree_avl_packed_destroy(AVLPackedTree *avl) {
+    assert(avl);
+    free(avl->nodes);
+}
+
+void
+tree_avl_packed_resize(AVLPackedTree *avl) {
+    idx_t new_capacity = avl->capacity*RESIZE_FACTOR;
+    if (new_capacity <= avl->capacity) new_capacity = avl->capacity + 1;
+    if (new_capacity >= AVL_PACKED_IDX_MASK) {
+        perror("Packed AVL tree exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+
+    AVLPackedNode* new_nodes = (AVLPackedNode*) realloc(avl->nodes, sizeof(AVLPackedNode)*new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate enough memory for tree resize.");
+        exit(EXIT_FAILURE);
+    }
+
+    avl->nodes = new_nodes;
+    avl->capacity = new_capacity;
+}
+
+/* As rotações só mexem nos índices, os equilíbrios são acertados em _avlp_rebalance */
+static idx_t
+_avlp_rotate_right(AVLPackedTree *avl, idx_t node_idx) {
+    g_rotation_count++;
+
+    AVLPackedNode *nodes = avl->nodes;
+    idx_t pivot = _avlp_left(&nodes[node_idx]);
+    _avlp_set_left(&nodes[node_idx], nodes[pivot].right);
+    nodes[pivot].right = node_idx;
+    return pivot;
+}
+
+static idx_t
+_avlp_rotate_left(AVLPackedTree *avl, idx_t node_idx) {
+    g_rotation_count++;
+
+    AVLPackedNode *nodes = avl->nodes;
+    idx_t pivot = nodes[node_idx].right;
+    nodes[node_idx].right = _avlp_left(&nodes[pivot]);
+    _avlp_set_left(&nodes[pivot], node_idx);
+    return pivot;
+}
+
+/* node_idx ficou com equilíbrio +-2 depois de uma inserção. Devolve a nova raiz
+ * da subárvore, que volta à altura que tinha antes da inserção */
+static idx_t
+_avlp_rebalance(AVLPackedTree *avl, idx_t node_idx, int balance) {
+    AVLPackedNode *nodes = avl->nodes;
+
+    if (balance > 1) {
+        idx_t child = _avlp_left(&nodes[node_idx]);
+        /* Left Left */
+        if (_avlp_balance(&nodes[child]) > 0) {
+            idx_t subtree = _avlp_rotate_right(avl, node_idx);
+            _avlp_set_balance(&nodes[node_idx], 0);
+            _avlp_set_balance(&nodes[child], 0);
+            return subtree;
+        }
+        /* Left Right */
+        idx_t grand = nodes[child].right;
+        int grand_balance = _avlp_balance(&nodes[grand]);
+        _avlp_set_left(&nodes[node_idx], _avlp_rotate_left(avl, child));
+        idx_t subtree = _avlp_rotate_right(avl, node_idx);
+        _avlp_set_balance(&nodes[node_idx], (grand_balance > 0) ? -1 : 0);
+        _avlp_set_balance(&nodes[child], (grand_balance < 0) ? 1 : 0);
+        _avlp_set_balance(&nodes[grand], 0);
+        return subtree;
+    }
+
+    idx_t child = nodes[node_idx].right;
+    /* Right Right */
+    if (_avlp_balance(&nodes[child]) < 0) {
+        idx_t subtree = _avlp_rotate_left(avl, node_idx);
+        _avlp_set_balance(&nodes[node_idx], 0);
+        _avlp_set_balance(&nodes[child], 0);
+        return subtree;
+    }
+    /* Right Left */
+    idx_t grand = _avlp_left(&nodes[child]);
+    int grand_balance = _avlp_balance(&nodes[grand]);
+    nodes[node_idx].right = _avlp_rotate_right(avl, child);
+    idx_t subtree = _avlp_rotate_left(avl, node_idx);
+    _avlp_set_balance(&nodes[node_idx], (grand_balance < 0) ? 1 : 0);
+    _avlp_set_balance(&nodes[child], (grand_balance > 0) ? -1 : 0);
+    _avlp_set_balance(&nodes[grand], 0);
+    return subtree;
+}
+
+/* Como tree_avl_insert_iter, mas com equilíbrios em vez de alturas: a subida
+ * pára num nó que fica equilibrado ou depois de uma rotação */
+void
+tree_avl_packed_insert(AVLPackedTree *avl, key_t key) {
+
+    if (avl->elements == avl->capacity) {
+        tree_avl_packed_resize(avl);
+    }
+
+    AVLPackedNode *nodes = avl->nodes;
+    idx_t path[TREE_MAX_DEPTH];
+    int depth = 0;
+
+    idx_t current = avl->tree_root;
+    while (current != IDX_INVALID) {
+        if (key == nodes[current].key) return;
+        path[depth++] = current;
+        current = (key < nodes[current].key) ? _avlp_left(&nodes[current]) : nodes[current].right;
+    }
+
+    idx_t new_index = avl->elements++;
+    nodes[new_index] = (AVLPackedNode) {0, IDX_INVALID, key};
+    _avlp_set_left(&nodes[new_index], IDX_INVALID);
+    _avlp_set_balance(&nodes[new_index], 0);
+
+    if (depth == 0) {
+        avl->tree_root = new_index;
+        return;
+    }
+
+    idx_t parent = path[depth-1];
+    if (key < nodes[parent].key) _avlp_set_left(&nodes[parent], new_index);
+    else nodes[parent].right = new_index;
+
+    for (int d = depth - 1; d >= 0; d--) {
+        idx_t node_index = path[d];
+        int balance = _avlp_balance(&nodes[node_index]) + ((key < nodes[node_index].key) ? 1 : -1);
+
+        if (balance == 0) {
+            _avlp_set_balance(&nodes[node_index], 0);
+            return;
+        }
+        if (balance == 1 || balance == -1) {
+            _avlp_set_balance(&nodes[node_index], balance);
+            continue;
+        }
+
+        idx_t subtree = _avlp_rebalance(avl, node_index, balance);
+        if (d == 0) {
+            avl->tree_root = subtree;
+        } else if (key < nodes[path[d-1]].key) {
+            _avlp_set_left(&nodes[path[d-1]], subtree);
+        } else {
+            nodes[path[d-1]].right = subtree;
+        }
+        return;
+    }
+}
+
+/* O GCC faz a escolha do filho em tree_avl_search com cmov; com a descodificação
+ * do índice esquerdo passa a um salto que falha metade das vezes e a pesquisa
+ * fica duas vezes mais lenta. A escolha é feita com máscaras sobre os campos
+ * crus e os bits de cima saem no fim (o direito não os tem) */
+idx_t
+tree_avl_packed_search(AVLPackedTree *avl, key_t key) {
+    AVLPackedNode *nodes = avl->nodes;
+    idx_t current = avl->tree_root & AVL_PACKED_IDX_MASK;
+
+    while (current != AVL_PACKED_IDX_MASK) {
+        if (nodes[current].key == key) return current;
+        idx_t go_right = -(idx_t) (key > nodes[current].key);
+        current = ((nodes[current].left_balance & ~go_right) | (nodes[current].right & go_right)) & AVL_PACKED_IDX_MASK;
+    }
+
+    return IDX_INVALID;
+}
+
+static inline idx_t
+_rbp_left(const RBPackedNode *node) {
+    idx_t left = node->left_color & RB_PACKED_IDX_MASK;
+    return (left == RB_PACKED_IDX_MASK) ? IDX_INVALID : left;
+}
+
+static inline void
+_rbp_set_left(RBPackedNode *node, idx_t left) {
+    node->left_color = (node->left_color & ~RB_PACKED_IDX_MASK) | (left & RB_PACKED_IDX_MASK);
+}
+
+static inline int
+_rbp_color(const RBPackedNode *node) {
+    return (int) (node->left_color >> 31);
+}
+
+static inline void
+_rbp_set_color(RBPackedNode *node, int color) {
+    node->left_color = (node->left_color & RB_PACKED_IDX_MASK) | ((idx_t) color << 31);
+}
+
+static inline int
+_rbp_is_red(RBPackedTree *tree, idx_t i) {
+    if (i == IDX_INVALID) return 0;
+    return _rbp_color(&tree->nodes[i]) == RED;
+}
+
+RBPackedTree
+tree_rb_packed_create(idx_t initial_capacity) {
+    assert(initial_capacity > 0);
+
+    RBPackedTree tree = {NULL, IDX_INVALID, 0, initial_capacity};
+    tree.nodes = (RBPackedNode*) malloc(sizeof(RBPackedNode) * initial_capacity);
+
+    if (tree.nodes == NULL) {
+        perror("Couldn't allocate packed Red-Black tree.");
+        exit(EXIT_FAILURE);
+    }
+    return tree;
+}
+
+void
+tree_rb_packed_destroy(RBPackedTree *tree) {
+    assert(tree);
+    free(tree->nodes);
+}
+
+void
+tree_rb_packed_resize(RBPackedTree *tree) {
+    idx_t new_capacity = tree->capacity*RESIZE_FACTOR;
+    if (new_capacity <= tree->capacity) new_capacity = tree->capacity + 1;
+    if (new_capacity >= RB_PACKED_IDX_MASK) {
+        perror("Packed Red-Black tree exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+
+    RBPackedNode *new_nodes = (RBPackedNode*) realloc(tree->nodes, sizeof(RBPackedNode)*new_capacity);
+    if (new_nodes == NULL) {
+        perror("Failed to allocate more nodes.");
+        exit(EXIT_FAILURE);
+    }
+
+    tree->nodes = new_nodes;
+    tree->capacity = new_capacity;
+}
+
+static idx_t
+_rbp_rotate_left(RBPackedTree *tree, idx_t h) {
+    g_rotation_count++;
+    RBPackedNode *nodes = tree->nodes;
+    idx_t pivot = nodes[h].right;
+    nodes[h].right = _rbp_left(&nodes[pivot]);
+    _rbp_set_left(&nodes[pivot], h);
+    _rbp_set_color(&nodes[pivot], _rbp_color(&nodes[h]));
+    _rbp_set_color(&nodes[h], RED);
+    return pivot;
+}
+
+static idx_t
+_rbp_rotate_right(RBPackedTree *tree, idx_t h) {
+    g_rotation_count++;
+    RBPackedNode *nodes = tree->nodes;
+    idx_t pivot = _rbp_left(&nodes[h]);
+    _rbp_set_left(&nodes[h], nodes[pivot].right);
+    nodes[pivot].right = h;
+    _rbp_set_color(&nodes[pivot], _rbp_color(&nodes[h]));
+    _rbp_set_color(&nodes[h], RED);
+    return pivot;
+}
+
+static void
+_rbp_flip_colors(RBPackedTree *tree, idx_t h) {
+    RBPackedNode *nodes = tree->nodes;
+    idx_t left = _rbp_left(&nodes[h]);
+    idx_t right = nodes[h].right;
+    _rbp_set_color(&nodes[h], !_rbp_color(&nodes[h]));
+    if (left != IDX_INVALID)
+        _rbp_set_color(&nodes[left], !_rbp_color(&nodes[left]));
+    if (right != IDX_INVALID)
+        _rbp_set_color(&nodes[right], !_rbp_color(&nodes[right]));
+}
+
+/* Igual a _rb_fix_up_tracked */
+static idx_t
+_rbp_fix_up(RBPackedTree *tree, idx_t h, int *changed) {
+    RBPackedNode *nodes = tree->nodes;
+
+    *changed = 0;
+    if (_rbp_is_red(tree, nodes[h].right) && !_rbp_is_red(tree, _rbp_left(&nodes[h]))) {
+        h = _rbp_rotate_left(tree, h);
+        *changed = 1;
+    }
+    if (_rbp_is_red(tree, _rbp_left(&nodes[h])) && _rbp_is_red(tree, _rbp_left(&nodes[_rbp_left(&nodes[h])]))) {
+        h = _rbp_rotate_right(tree, h);
+        *changed = 1;
+    }
+    if (_rbp_is_red(tree, _rbp_left(&nodes[h])) && _rbp_is_red(tree, nodes[h].right)) {
+        _rbp_flip_colors(tree, h);
+        *changed = 1;
+    }
+
+    return h;
+}
+
+/* Mesma subida que tree_rb_insert_iter */
+void
+tree_rb_packed_insert(RBPackedTree *tree, key_t key) {
+
+    if (tree->capacity == tree->elements)
+        tree_rb_packed_resize(tree);
+
+    RBPackedNode *nodes = tree->nodes;
+    idx_t path[TREE_MAX_DEPTH];
+    int depth = 0;
+
+    idx_t current = tree->tree_root;
+    while (current != IDX_INVALID) {
+        if (key == nodes[current].key) return;
+        path[depth++] = current;
+        current = (key < nodes[current].key) ? _rbp_left(&nodes[current]) : nodes[current].right;
+    }
+
+    idx_t new_index = tree->elements++;
+    nodes[new_index] = (RBPackedNode) {0, IDX_INVALID, key};
+    _rbp_set_left(&nodes[new_index], IDX_INVALID);
+    _rbp_set_color(&nodes[new_index], RED);
+
+    idx_t child = new_index;
+    int d = depth - 1;
+    for (; d >= 0; d--) {
+        idx_t h = path[d];
+        if (key < nodes[h].key) _rbp_set_left(&nodes[h], child);
+        else nodes[h].right = child;
+
+        int changed;
+        child = _rbp_fix_up(tree, h, &changed);
+        if (!changed && _rbp_color(&nodes[child]) == BLACK) break;
+    }
+
+    if (d < 0) tree->tree_root = child;
+    _rbp_set_color(&nodes[tree->tree_root], BLACK);
+}
+
+/* Como tree_avl_packed_search */
+idx_t
+tree_rb_packed_search(RBPackedTree *tree, key_t key) {
+    RBPackedNode *nodes = tree->nodes;
+    idx_t current = tree->tree_root & RB_PACKED_IDX_MASK;
+
+    while (current != RB_PACKED_IDX_MASK) {
+        if (nodes[current].key == key) return current;
+        idx_t go_right = -(idx_t) (key > nodes[current].key);
+        current = ((nodes[current].left_color & ~go_right) | (nodes[current].right & go_right)) & RB_PACKED_IDX_MASK;
+    }
+
+    return IDX_INVALID;
+}
+
+/* Inserção (iterativa nos dois layouts) e pesquisa de todas as chaves.
+ * bytes/key conta o arena inteiro, incluindo a capacidade por usar */
+void
+packed_test_and_log(key_t* arr, FILE *fptr) {
+
+    clock_t start = 0, end = 0;
+    clock_t insert_wide = 0, insert_packed = 0, search_wide = 0, search_packed = 0;
+    idx_t hits = 0;
+    double lookups = (double) g_treesize * g_average / 1e6;
+    double bytes_wide = 0, bytes_packed = 0;
+
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        AVLTree avl = tree_avl_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_avl_insert_iter(&avl, arr[idx]);
+        end = clock();
+        insert_wide += (end-start);
+
+        start = clock();
+        AVLPackedTree packed = tree_avl_packed_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_avl_packed_insert(&packed, arr[idx]);
+        end = clock();
+        insert_packed += (end-start);
+
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_avl_search(&avl, arr[idx]) != NULL);
+        end = clock();
+        search_wide += (end-start);
+
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_avl_packed_search(&packed, arr[idx]) != IDX_INVALID);
+        end = clock();
+        search_packed += (end-start);
+
+        bytes_wide = (double) sizeof(AVLNode) * avl.capacity / avl.elements;
+        bytes_packed = (double) sizeof(AVLPackedNode) * packed.capacity / packed.elements;
+        tree_avl_destroy(&avl);
+        tree_avl_packed_destroy(&packed);
+    }
+    fprintf(fptr, "AVL %zuB = %0.4lfms, %0.2lf Mlookups/s, %0.2lf bytes/key\tpacked %zuB = %0.4lfms, %0.2lf Mlookups/s, %0.2lf bytes/key\t(%u hits)\n",
+            sizeof(AVLNode), ((double) insert_wide*1000) / CLOCKS_PER_SEC / g_average,
+            lookups / ((double) search_wide / CLOCKS_PER_SEC), bytes_wide,
+            sizeof(AVLPackedNode), ((double) insert_packed*1000) / CLOCKS_PER_SEC / g_average,
+            lookups / ((double) search_packed / CLOCKS_PER_SEC), bytes_packed, hits / g_average / 2);
+
+    insert_wide = insert_packed = search_wide = search_packed = 0;
+    hits = 0;
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        RBTree rb = tree_rb_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_rb_insert_iter(&rb, arr[idx]);
+        end = clock();
+        insert_wide += (end-start);
+
+        start = clock();
+        RBPackedTree packed = tree_rb_packed_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_rb_packed_insert(&packed, arr[idx]);
+        end = clock();
+        insert_packed += (end-start);
+
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_rb_search(&rb, arr[idx]) != -1);
+        end = clock();
+        search_wide += (end-start);
+
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_rb_packed_search(&packed, arr[idx]) != IDX_INVALID);
+        end = clock();
+        search_packed += (end-start);
+
+        bytes_wide = (double) sizeof(RBNode) * rb.capacity / rb.elements;
+        bytes_packed = (double) sizeof(RBPackedNode) * packed.capacity / packed.elements;
+        tree_rb_destroy(&rb);
+        tree_rb_packed_destroy(&packed);
+    }
+    fprintf(fptr, "RB %zuB = %0.4lfms, %0.2lf Mlookups/s, %0.2lf bytes/key\tpacked %zuB = %0.4lfms, %0.2lf Mlookups/s, %0.2lf bytes/key\t(%u hits)\n",
+            sizeof(RBNode), ((double) insert_wide*1000) / CLOCKS_PER_SEC / g_average,
+            lookups / ((double) search_wide / CLOCKS_PER_SEC), bytes_wide,
+            sizeof(RBPackedNode), ((double) insert_packed*1000) / CLOCKS_PER_SEC / g_average,
+            lookups / ((double) search_packed / CLOCKS_PER_SEC), bytes_packed, hits / g_average / 2);
+}
+
+/* ===== B+ TREE ===== */
+
+BTree
+tree_btree_create(idx_t initial_capacity) {
+    assert(initial_capacity > 0);
+    assert(sizeof(BTreeInner) == 128 && sizeof(BTreeLeaf) == 128);
+
+    BTree bt;
+    memset(&bt, 0, sizeof(bt));
+    bt.tree_root = IDX_INVALID;
+    bt.inner = _btree_grow(NULL, sizeof(BTreeInner), 0, &bt.inner_capacity);
+    bt.leaf_capacity = initial_capacity;
+    bt.leaves = _btree_grow(NULL, sizeof(BTreeLeaf), 0, &bt.leaf_capacity);
+    return bt;
+}
+
+void
+tree_btree_destroy(BTree *bt) {
+    assert(bt);
+    free(bt->inner);
+    free(bt->leaves);
+}
+
+/* realloc não garante alinhamento, os nós ficam sempre em 64 bytes para cada
+ * nó ocupar exatamente duas linhas. Com capacity == 0 só reserva o inicial */
+static void *
+_btree_grow(void *nodes, size_t node_size, idx_t elements, idx_t *capacity) {
+    idx_t new_capacity = (*capacity == 0) ? 4 : (nodes == NULL ? *capacity : *capacity*RESIZE_FACTOR);
+    if (nodes != NULL && new_capacity <= *capacity) new_capacity = *capacity + 1;
+    if (new_capacity >= IDX_INVALID || new_capacity <= elements) {
+        perror("B+ tree exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+
+    void *new_nodes = NULL;
+    if (posix_memalign(&new_nodes, 64, node_size * new_capacity) != 0) {
+        perror("Failed to allocate enough memory for tree resize.");
+        exit(EXIT_FAILURE);
+    }
+    if (nodes != NULL) {
+        memcpy(new_nodes, nodes, node_size * elements);
+        free(nodes);
+    }
+
+    *capacity = new_capacity;
+    return new_nodes;
+}
+
+static idx_t
+_btree_new_inner(BTree *bt) {
+    if (bt->inner_elements == bt->inner_capacity)
+        bt->inner = _btree_grow(bt->inner, sizeof(BTreeInner), bt->inner_elements, &bt->inner_capacity);
+    idx_t idx = bt->inner_elements++;
+    bt->inner[idx].count = 0;
+    return idx;
+}
+
+static idx_t
+_btree_new_leaf(BTree *bt) {
+    if (bt->leaf_elements == bt->leaf_capacity)
+        bt->leaves = _btree_grow(bt->leaves, sizeof(BTreeLeaf), bt->leaf_elements, &bt->leaf_capacity);
+    idx_t idx = bt->leaf_elements++;
+    bt->leaves[idx].count = 0;
+    bt->leaves[idx].next = IDX_INVALID;
+    return idx;
+}
+
+/* Chaves <= key, as chaves estão ordenadas por isso é o índice do filho */
+static int
+_btree_inner_rank(const BTreeInner *node, key_t key) {
+    int rank = 0;
+    for (idx_t i = 0; i < node->count; i++)
+        rank += (node->keys[i] <= key);
+    return rank;
+}
+
+static int
+_btree_leaf_lower(const BTreeLeaf *leaf, key_t key) {
+    int pos = 0;
+    for (idx_t i = 0; i < leaf->count; i++)
+        pos += (leaf->keys[i] < key);
+    return pos;
+}
+
+#ifdef BTREE_HAVE_X86
+/* As 16 lanes são as 15 chaves e o count, a máscara deixa só as chaves usadas */
+__attribute__((target("avx2,popcnt")))
+static inline int
+_btree_inner_rank_avx2(const BTreeInner *node, key_t key) {
+    __m256i k = _mm256_set1_epi32(key);
+    __m256i lo = _mm256_loadu_si256((const __m256i*) node->keys);
+    __m256i hi = _mm256_loadu_si256((const __m256i*) (node->keys + 8));
+    unsigned greater = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lo, k)))
+                     | (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(hi, k))) << 8;
+    return __builtin_popcount(~greater & ((1u << node->count) - 1));
+}
+
+/* 32 lanes: as 30 chaves, count e next */
+__attribute__((target("avx2,popcnt")))
+static inline idx_t
+_btree_leaf_find_avx2(const BTreeLeaf *leaf, key_t key) {
+    __m256i k = _mm256_set1_epi32(key);
+    unsigned equal = 0;
+    for (int v = 0; v < 4; v++) {
+        __m256i keys = _mm256_loadu_si256((const __m256i*) (leaf->keys + 8*v));
+        equal |= (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(keys, k))) << (8*v);
+    }
+    equal &= (1u << leaf->count) - 1;
+    return equal ? (idx_t) __builtin_ctz(equal) : IDX_INVALID;
+}
+
+__attribute__((target("avx2,popcnt")))
+static idx_t
+_btree_search_avx2(BTree *bt, key_t key) {
+    idx_t node = bt->tree_root;
+    for (int level = bt->height; level > 0; level--)
+        node = bt->inner[node].child[_btree_inner_rank_avx2(&bt->inner[node], key)];
+
+    idx_t pos = _btree_leaf_find_avx2(&bt->leaves[node], key);
+    return (pos == IDX_INVALID) ? IDX_INVALID : node * BTREE_LEAF_KEYS + pos;
+}
+
+/* Todas as folhas estão à mesma profundidade, o grupo desce em passo certo e
+ * cada nó seguinte (duas linhas) é pedido antes de passar à pesquisa seguinte */
+__attribute__((target("avx2,popcnt")))
+static void
+_btree_search_batch_avx2(BTree *bt, const key_t *keys, size_t n, idx_t *out_idx) {
+    idx_t node[SEARCH_GROUP];
+
+    for (size_t base = 0; base < n; base += SEARCH_GROUP) {
+        int group = (n - base < SEARCH_GROUP) ? (int) (n - base) : SEARCH_GROUP;
+
+        for (int g = 0; g < group; g++) node[g] = bt->tree_root;
+
+        for (int level = bt->height; level > 0; level--) {
+            for (int g = 0; g < group; g++) {
+                node[g] = bt->inner[node[g]].child[_btree_inner_rank_avx2(&bt->inner[node[g]], keys[base + g])];
+                const char *next = (level > 1) ? (const char*) &bt->inner[node[g]] : (const char*) &bt->leaves[node[g]];
+                __builtin_prefetch(next);
+                __builtin_prefetch(next + 64);
+            }
+        }
+
+        for (int g = 0; g < group; g++) {
+            idx_t pos = _btree_leaf_find_avx2(&bt->leaves[node[g]], keys[base + g]);
+            out_idx[base + g] = (pos == IDX_INVALID) ? IDX_INVALID : node[g] * BTREE_LEAF_KEYS + pos;
+        }
+    }
+}
+#endif
+
+static idx_t
+_btree_search_scalar(BTree *bt, key_t key) {
+    idx_t node = bt->tree_root;
+    for (int level = bt->height; level > 0; level--)
+        node = bt->inner[node].child[_btree_inner_rank(&bt->inner[node], key)];
+
+    BTreeLeaf *leaf = &bt->leaves[node];
+    idx_t pos = _btree_leaf_lower(leaf, key);
+    return (pos < leaf->count && leaf->keys[pos] == key) ? node * BTREE_LEAF_KEYS + pos : IDX_INVALID;
+}
+
+static void
+_btree_search_batch_scalar(BTree *bt, const key_t *keys, size_t n, idx_t *out_idx) {
+    idx_t node[SEARCH_GROUP];
+
+    for (size_t base = 0; base < n; base += SEARCH_GROUP) {
+        int group = (n - base < SEARCH_GROUP) ? (int) (n - base) : SEARCH_GROUP;
+
+        for (int g = 0; g < group; g++) node[g] = bt->tree_root;
+
+        for (int level = bt->height; level > 0; level--) {
+            for (int g = 0; g < group; g++) {
+                node[g] = bt->inner[node[g]].child[_btree_inner_rank(&bt->inner[node[g]], keys[base + g])];
+                const char *next = (level > 1) ? (const char*) &bt->inner[node[g]] : (const char*) &bt->leaves[node[g]];
+                __builtin_prefetch(next);
+                __builtin_prefetch(next + 64);
+            }
+        }
+
+        for (int g = 0; g < group; g++) {
+            BTreeLeaf *leaf = &bt->leaves[node[g]];
+            idx_t pos = _btree_leaf_lower(leaf, keys[base + g]);
+            out_idx[base + g] = (pos < leaf->count && leaf->keys[pos] == keys[base + g])
+                              ? node[g] * BTREE_LEAF_KEYS + pos : IDX_INVALID;
+        }
+    }
+}
+
+idx_t
+tree_btree_search(BTree *bt, key_t key) {
+    if (bt->tree_root == IDX_INVALID) return IDX_INVALID;
+#ifdef BTREE_HAVE_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return _btree_search_avx2(bt, key);
+#endif
+    return _btree_search_scalar(bt, key);
+}
+
+void
+tree_btree_search_batch(BTree *bt, const key_t *keys, size_t n, idx_t *out_idx) {
+    if (bt->tree_root == IDX_INVALID) {
+        for (size_t k = 0; k < n; k++) out_idx[k] = IDX_INVALID;
+        return;
+    }
+#ifdef BTREE_HAVE_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        _btree_search_batch_avx2(bt, keys, n, out_idx);
+        return;
+    }
+#endif
+    _btree_search_batch_scalar(bt, keys, n, out_idx);
+}
+
+/* Desce guardando o caminho, insere na folha e, se encher, parte ao meio e
+ * sobe a chave separadora até um pai com espaço ou até criar nova raiz */
+void
+tree_btree_insert(BTree *bt, key_t key) {
+
+    if (bt->tree_root == IDX_INVALID) {
+        bt->tree_root = _btree_new_leaf(bt);
+        bt->height = 0;
+    }
+
+    idx_t path[BTREE_MAX_HEIGHT];
+    int slot[BTREE_MAX_HEIGHT];
+    idx_t node = bt->tree_root;
+    for (int d = 0; d < bt->height; d++) {
+        path[d] = node;
+        slot[d] = _btree_inner_rank(&bt->inner[node], key);
+        node = bt->inner[node].child[slot[d]];
+    }
+
+    BTreeLeaf *leaf = &bt->leaves[node];
+    int pos = _btree_leaf_lower(leaf, key);
+    if (pos < (int) leaf->count && leaf->keys[pos] == key) return;
+    bt->elements++;
+
+    if (leaf->count < BTREE_LEAF_KEYS) {
+        memmove(leaf->keys + pos + 1, leaf->keys + pos, sizeof(key_t) * (leaf->count - pos));
+        leaf->keys[pos] = key;
+        leaf->count++;
+        return;
+    }
+
+    /* partir a folha: a metade de cima vai para uma folha nova à direita */
+    key_t merged[BTREE_LEAF_KEYS + 1];
+    memcpy(merged, leaf->keys, sizeof(key_t) * pos);
+    merged[pos] = key;
+    memcpy(merged + pos + 1, leaf->keys + pos, sizeof(key_t) * (BTREE_LEAF_KEYS - pos));
+
+    idx_t right = _btree_new_leaf(bt);
+    BTreeLeaf *left_leaf = &bt->leaves[node];
+    BTreeLeaf *right_leaf = &bt->leaves[right];
+    int half = (BTREE_LEAF_KEYS + 1) / 2;
+    memcpy(left_leaf->keys, merged, sizeof(key_t) * half);
+    memcpy(right_leaf->keys, merged + half, sizeof(key_t) * (BTREE_LEAF_KEYS + 1 - half));
+    left_leaf->count = half;
+    right_leaf->count = BTREE_LEAF_KEYS + 1 - half;
+    right_leaf->next = left_leaf->next;
+    left_leaf->next = right;
+
+    key_t separator = right_leaf->keys[0];
+
+    for (int d = bt->height - 1; d >= 0; d--) {
+        BTreeInner *parent = &bt->inner[path[d]];
+        int s = slot[d];
+
+        if (parent->count < BTREE_INNER_KEYS) {
+            memmove(parent->keys + s + 1, parent->keys + s, sizeof(key_t) * (parent->count - s));
+            memmove(parent->child + s + 2, parent->child + s + 1, sizeof(idx_t) * (parent->count - s));
+            parent->keys[s] = separator;
+            parent->child[s + 1] = right;
+            parent->count++;
+            return;
+        }
+
+        /* partir o nó interior, a chave do meio sobe */
+        key_t keys[BTREE_INNER_KEYS + 1];
+        idx_t child[BTREE_INNER_KEYS + 2];
+        memcpy(keys, parent->keys, sizeof(key_t) * s);
+        keys[s] = separator;
+        memcpy(keys + s + 1, parent->keys + s, sizeof(key_t) * (BTREE_INNER_KEYS - s));
+        memcpy(child, parent->child, sizeof(idx_t) * (s + 1));
+        child[s + 1] = right;
+        memcpy(child + s + 2, parent->child + s + 1, sizeof(idx_t) * (BTREE_INNER_KEYS - s));
+
+        idx_t new_inner = _btree_new_inner(bt);
+        BTreeInner *left_inner = &bt->inner[path[d]];
+        BTreeInner *right_inner = &bt->inner[new_inner];
+        int mid = (BTREE_INNER_KEYS + 1) / 2;
+        memcpy(left_inner->keys, keys, sizeof(key_t) * mid);
+        memcpy(left_inner->child, child, sizeof(idx_t) * (mid + 1));
+        left_inner->count = mid;
+        memcpy(right_inner->keys, keys + mid + 1, sizeof(key_t) * (BTREE_INNER_KEYS - mid));
+        memcpy(right_inner->child, child + mid + 1, sizeof(idx_t) * (BTREE_INNER_KEYS + 1 - mid));
+        right_inner->count = BTREE_INNER_KEYS - mid;
+
+        separator = keys[mid];
+        right = new_inner;
+    }
+
+    /* a raiz partiu */
+    assert(bt->height + 1 < BTREE_MAX_HEIGHT);
+    idx_t root = _btree_new_inner(bt);
+    bt->inner[root].count = 1;
+    bt->inner[root].keys[0] = separator;
+    bt->inner[root].child[0] = bt->tree_root;
+    bt->inner[root].child[1] = right;
+    bt->tree_root = root;
+    bt->height++;
+}
+
+void
+tree_btree_insert_arr(BTree *bt, key_t* arr, size_t size) {
+    assert(bt && arr);
+    for (key_t* endptr = arr+size; arr != endptr; arr++) {
+        tree_btree_insert(bt, *arr);
+    }
+}
+
+/* Folhas cheias da esquerda para a direita, depois cada nível interior por cima
+ * do anterior. Os nós de cada nível dividem os filhos por igual, nenhum fica
+ * com menos de metade. low guarda a menor chave de cada nó do nível de baixo */
+BTree
+tree_btree_build_sorted(key_t* arr, size_t size) {
+    key_t* sorted = (key_t*) malloc(sizeof(key_t) * (size + 1));
+    if (sorted == NULL) {
+        perror("Failed to allocate sorted copy.");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = arr_unique_sorted(arr, size, sorted, sizeof(key_t));
+
+    idx_t leaves = (count + BTREE_LEAF_KEYS - 1) / BTREE_LEAF_KEYS;
+    BTree bt = tree_btree_create(leaves > 0 ? leaves : 1);
+    if (count == 0) {
+        free(sorted);
+        return bt;
+    }
+
+    key_t *low = (key_t*) malloc(sizeof(key_t) * leaves);
+    if (low == NULL) {
+        perror("Failed to allocate separator buffer.");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t k = 0;
+    for (idx_t l = 0; l < leaves; l++) {
+        idx_t idx = _btree_new_leaf(&bt);
+        idx_t take = count / leaves + (l < count % leaves);
+        memcpy(bt.leaves[idx].keys, sorted + k, sizeof(key_t) * take);
+        bt.leaves[idx].count = take;
+        bt.leaves[idx].next = (l + 1 < leaves) ? idx + 1 : IDX_INVALID;
+        low[l] = sorted[k];
+        k += take;
+    }
+    bt.elements = count;
+
+    idx_t first = 0;        // primeiro nó do nível de baixo
+    idx_t level_nodes = leaves;
+    while (level_nodes > 1) {
+        idx_t parents = (level_nodes + BTREE_INNER_KEYS) / (BTREE_INNER_KEYS + 1);
+        idx_t parent_first = bt.inner_elements;
+        idx_t c = 0;
+        for (idx_t p = 0; p < parents; p++) {
+            idx_t idx = _btree_new_inner(&bt);
+            idx_t take = level_nodes / parents + (p < level_nodes % parents);
+            for (idx_t j = 0; j < take; j++, c++) {
+                bt.inner[idx].child[j] = first + c;
+                if (j > 0) bt.inner[idx].keys[j-1] = low[c];
+            }
+            bt.inner[idx].count = take - 1;
+            low[p] = low[c - take];
+        }
+        first = parent_first;
+        level_nodes = parents;
+        bt.height++;
+    }
+
+    bt.tree_root = (bt.height == 0) ? 0 : first;
+    free(low);
+    free(sorted);
+    return bt;
+}
+
+void
+btree_test_and_log(key_t* arr, FILE *fptr) {
+
+    BTree bt;
+    clock_t start = 0, end = 0;
+    clock_t total = 0, total_bulk = 0, total_search = 0, total_batch = 0;
+    idx_t hits = 0;
+    idx_t *out_idx = malloc(sizeof(idx_t) * g_treesize);
+    double lookups = (double) g_treesize * g_average / 1e6;
+
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        bt = tree_btree_create(10);
+        tree_btree_insert_arr(&bt, arr, g_treesize);
+        end = clock();
+        perf_stop(&g_perf);
+
+        total += (end-start);
+        tree_btree_destroy(&bt);
+    }
+
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        bt = tree_btree_build_sorted(arr, g_treesize);
+        end = clock();
+        total_bulk += (end-start);
+
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_btree_search(&bt, arr[idx]) != IDX_INVALID);
+        end = clock();
+        total_search += (end-start);
+
+        start = clock();
+        tree_btree_search_batch(&bt, arr, g_treesize, out_idx);
+        end = clock();
+        total_batch += (end-start);
+
+        tree_btree_destroy(&bt);
+    }
+
+    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
+    fprintf(fptr, "B+ TREE = %0.4lfms\t(bulk %0.4lfms, search %0.2lf Mlookups/s, batch %0.2lf Mlookups/s, %u hits)",
+            total_time/g_average, ((double) total_bulk*1000) / CLOCKS_PER_SEC / g_average,
+            lookups / ((double) total_search / CLOCKS_PER_SEC), lookups / ((double) total_batch / CLOCKS_PER_SEC),
+            hits / g_average);
+    perf_log(fptr, &g_perf, g_average);
+    free(out_idx);
+}
+
+/* ===== FROZEN TREES ===== */
+
+/* A BinTree não está ordenada, as chaves são ordenadas numa cópia */
+size_t
+tree_binary_sorted_keys(BinTree *btree, key_t *out) {
+    key_t *copy = (key_t*) malloc(sizeof(key_t) * (btree->elements + 1));
+    if (copy == NULL) {
+        perror("Failed to allocate key copy.");
+        exit(EXIT_FAILURE);
+    }
+    for (idx_t idx = 0; idx < btree->elements; idx++)
+        copy[idx] = btree->root[idx].data;
+
+    size_t count = arr_unique_sorted(copy, btree->elements, out, sizeof(key_t));
+    free(copy);
+    return count;
+}
+
+/* ===== ORDER STATISTICS ===== */
+#ifdef TREE_ORDER_STATS
+
+#define ARENA_IDX(nodes, stride, i, offset) (*(const idx_t*) ((nodes) + (stride)*(i) + (offset)))
+
+/* Uma descida: cada vez que se vai para a direita contam-se o nó e a sua
+ * subárvore esquerda. Os campos são lidos por offset como em _arena_preorder */
+static idx_t
+_arena_rank(const char *nodes, size_t stride, size_t key_offset, size_t left_offset,
+            size_t right_offset, size_t size_offset, idx_t root, key_t key) {
+    idx_t rank = 0;
+    idx_t node = root;
+    while (node != IDX_INVALID) {
+        idx_t left = ARENA_IDX(nodes, stride, node, left_offset);
+        if (key <= *(const key_t*) (nodes + stride*node + key_offset)) {
+            node = left;
+        } else {
+            rank += 1 + ((left == IDX_INVALID) ? 0 : ARENA_IDX(nodes, stride, left, size_offset));
+            node = ARENA_IDX(nodes, stride, node, right_offset);
+        }
+    }
+    return rank;
+}
+
+static idx_t
+_arena_select(const char *nodes, size_t stride, size_t left_offset,
+              size_t right_offset, size_t size_offset, idx_t root, idx_t k) {
+    idx_t node = root;
+    while (node != IDX_INVALID) {
+        idx_t left = ARENA_IDX(nodes, stride, node, left_offset);
+        idx_t left_size = (left == IDX_INVALID) ? 0 : ARENA_IDX(nodes, stride, left, size_offset);
+        if (k < left_size) {
+            node = left;
+        } else if (k == left_size) {
+            return node;
+        } else {
+            k -= left_size + 1;
+            node = ARENA_IDX(nodes, stride, node, right_offset);
+        }
+    }
+    return IDX_INVALID;
+}
+
+idx_t
+tree_avl_rank(AVLTree *avl, key_t key) {
+    return _arena_rank((const char*) avl->nodes, sizeof(AVLNode), offsetof(AVLNode, key), offsetof(AVLNode, left),
+                       offsetof(AVLNode, right), offsetof(AVLNode, size),
+                       (avl->elements == 0) ? IDX_INVALID : avl->tree_root, key);
+}
+
+idx_t
+tree_avl_select(AVLTree *avl, idx_t k) {
+    return _arena_select((const char*) avl->nodes, sizeof(AVLNode), offsetof(AVLNode, left),
+                         offsetof(AVLNode, right), offsetof(AVLNode, size),
+                         (avl->elements == 0) ? IDX_INVALID : avl->tree_root, k);
+}
+
+idx_t
+tree_rb_rank(RBTree *tree, key_t key) {
+    return _arena_rank((const char*) tree->nodes, sizeof(RBNode), offsetof(RBNode, key), offsetof(RBNode, left),
+                       offsetof(RBNode, right), offsetof(RBNode, size), tree->tree_root, key);
+}
+
+idx_t
+tree_rb_select(RBTree *tree, idx_t k) {
+    return _arena_select((const char*) tree->nodes, sizeof(RBNode), offsetof(RBNode, left),
+                         offsetof(RBNode, right), offsetof(RBNode, size), tree->tree_root, k);
+}
+
+idx_t
+tree_treap_rank(Treap *treap, key_t key) {
+    return _arena_rank((const char*) treap->nodes, sizeof(TreapNode), offsetof(TreapNode, key), offsetof(TreapNode, left),
+                       offsetof(TreapNode, right), offsetof(TreapNode, size), treap->tree_root, key);
+}
+
+idx_t
+tree_treap_select(Treap *treap, idx_t k) {
+    return _arena_select((const char*) treap->nodes, sizeof(TreapNode), offsetof(TreapNode, left),
+                         offsetof(TreapNode, right), offsetof(TreapNode, size), treap->tree_root, k);
+}
+
+/* rank e select de todas as chaves em cada árvore. O custo das inserções com o
+ * campo extra vê-se comparando as linhas AVL/RB/TREAP com as de um build normal */
+void
+order_test_and_log(key_t* arr, FILE *fptr) {
+
+    AVLTree avl = tree_avl_create(10);
+    RBTree rb = tree_rb_create(10);
+    Treap treap = tree_treap_create(10);
+    tree_avl_insert_arr(&avl, arr, g_treesize);
+    for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++) {
+        tree_rb_insert(&rb, arr[idx]);
+        tree_treap_insert(&treap, arr[idx]);
+    }
+
+    key_t *sorted = malloc(sizeof(key_t) * g_treesize);
+    idx_t count = tree_avl_sorted_keys(&avl, sorted);
+    clock_t start = 0, end = 0;
+    clock_t total_rank[3] = {0}, total_select[3] = {0};
+    idx_t errors = 0;
+
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (tree_avl_rank(&avl, sorted[k]) != k);
+        end = clock();
+        total_rank[0] += (end-start);
+
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (avl.nodes[tree_avl_select(&avl, k)].key != sorted[k]);
+        end = clock();
+        total_select[0] += (end-start);
+
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (tree_rb_rank(&rb, sorted[k]) != k);
+        end = clock();
+        total_rank[1] += (end-start);
+
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (rb.nodes[tree_rb_select(&rb, k)].key != sorted[k]);
+        end = clock();
+        total_select[1] += (end-start);
+
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (tree_treap_rank(&treap, sorted[k]) != k);
+        end = clock();
+        total_rank[2] += (end-start);
+
+        start = clock();
+        for (idx_t k = 0; k < count; k++) errors += (treap.nodes[tree_treap_select(&treap, k)].key != sorted[k]);
+        end = clock();
+        total_select[2] += (end-start);
+    }
+
+    double ns = 1e9 / CLOCKS_PER_SEC / ((double) (count ? count : 1) * g_average);
+    fprintf(fptr, "AVL rank = %0.1lfns select = %0.1lfns\tRB rank = %0.1lfns select = %0.1lfns"
+            "\tTREAP rank = %0.1lfns select = %0.1lfns\t(%u errors)\n",
+            total_rank[0]*ns, total_select[0]*ns, total_rank[1]*ns, total_select[1]*ns,
+            total_rank[2]*ns, total_select[2]*ns, errors);
+
+    free(sorted);
+    tree_avl_destroy(&avl);
+    tree_rb_destroy(&rb);
+    tree_treap_destroy(&treap);
+}
+#endif
+
+/* ===== SNAPSHOT AVL (EPOCH) ===== */
+
+SnapTree
+tree_snap_create(void) {
+    SnapTree tree;
+    tree.chunks = (SnapNode**) calloc(SNAP_MAX_CHUNKS, sizeof(SnapNode*));
+    if (tree.chunks == NULL || posix_memalign((void**) &tree.readers, 64, sizeof(SnapReader) * SNAP_MAX_READERS) != 0) {
+        perror("Failed to allocate snapshot tree.");
+        exit(EXIT_FAILURE);
+    }
+    memset(tree.readers, 0, sizeof(SnapReader) * SNAP_MAX_READERS);
+
+    tree.root = IDX_INVALID;
+    tree.elements = 0;
+    tree.next_slot = 0;
+    tree.free_head = IDX_INVALID;
+    tree.epoch = 1;
+    tree.retired = NULL;
+    tree.retired_count = 0;
+    tree.retired_capacity = 0;
+    return tree;
+}
+
+/* Só depois de todos os leitores terem terminado */
+void
+tree_snap_destroy(SnapTree *tree) {
+    for (idx_t c = 0; c < SNAP_MAX_CHUNKS && tree->chunks[c] != NULL; c++)
+        free(tree->chunks[c]);
+    free(tree->chunks);
+    free(tree->readers);
+    free(tree->retired);
+}
+
+static inline SnapNode*
+_snap_node(const SnapTree *tree, idx_t idx) {
+    return &tree->chunks[idx >> SNAP_CHUNK_BITS][idx & ((1u << SNAP_CHUNK_BITS) - 1)];
+}
+
+/* Um bloco novo fica no diretório antes de qualquer nó dele ser publicado,
+ * a publicação da raiz (seq_cst) torna-o visível aos leitores */
+static idx_t
+_snap_alloc(SnapTree *tree) {
+    if (tree->free_head != IDX_INVALID) {
+        idx_t idx = tree->free_head;
+        tree->free_head = _snap_node(tree, idx)->left;
+        return idx;
+    }
+
+    idx_t chunk = tree->next_slot >> SNAP_CHUNK_BITS;
+    if (chunk >= SNAP_MAX_CHUNKS) {
+        perror("Snapshot tree exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+    if (tree->chunks[chunk] == NULL) {
+        tree->chunks[chunk] = (SnapNode*) malloc(sizeof(SnapNode) << SNAP_CHUNK_BITS);
+        if (tree->chunks[chunk] == NULL) {
+            perror("Failed to allocate snapshot chunk.");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return tree->next_slot++;
+}
+
+static idx_t
+_snap_copy(SnapTree *tree, idx_t old) {
+    idx_t idx = _snap_alloc(tree);
+    *_snap_node(tree, idx) = *_snap_node(tree, old);
+
+    if (tree->retired_count == tree->retired_capacity) {
+        size_t new_capacity = (tree->retired_capacity == 0) ? SNAP_RECLAIM_BATCH : tree->retired_capacity*2;
+        SnapRetired *new_retired = (SnapRetired*) realloc(tree->retired, sizeof(SnapRetired) * new_capacity);
+        if (new_retired == NULL) {
+            perror("Failed to allocate snapshot retire list.");
+            exit(EXIT_FAILURE);
+        }
+        tree->retired = new_retired;
+        tree->retired_capacity = new_capacity;
+    }
+    tree->retired[tree->retired_count++] = (SnapRetired) {old, tree->epoch};
+    return idx;
+}
+
+static inline int
+_snap_height(const SnapTree *tree, idx_t idx) {
+    return (idx == IDX_INVALID) ? 0 : _snap_node(tree, idx)->height;
+}
+
+/* As rotações só tocam em nós copiados nesta versão (o nó e o filho do caminho),
+ * por isso podem ser feitas no sítio como na AVL normal */
+static idx_t
+_snap_rotate_right(SnapTree *tree, idx_t node_idx) {
+    g_rotation_count++;
+    SnapNode *node = _snap_node(tree, node_idx);
+    idx_t pivot_idx = node->left;
+    SnapNode *pivot = _snap_node(tree, pivot_idx);
+
+    node->left = pivot->right;
+    pivot->right = node_idx;
+    node->height = 1 + max(_snap_height(tree, node->left), _snap_height(tree, node->right));
+    pivot->height = 1 + max(_snap_height(tree, pivot->left), node->height);
+    return pivot_idx;
+}
+
+static idx_t
+_snap_rotate_left(SnapTree *tree, idx_t node_idx) {
+    g_rotation_count++;
+    SnapNode *node = _snap_node(tree, node_idx);
+    idx_t pivot_idx = node->right;
+    SnapNode *pivot = _snap_node(tree, pivot_idx);
+
+    node->right = pivot->left;
+    pivot->left = node_idx;
+    node->height = 1 + max(_snap_height(tree, node->left), _snap_height(tree, node->right));
+    pivot->height = 1 + max(node->height, _snap_height(tree, pivot->right));
+    return pivot_idx;
+}
+
+/* Como _avl_insert_recursive, mas cada nó do caminho é primeiro copiado.
+ * A chave já se sabe que não existe */
+static idx_t
+_snap_insert_recursive(SnapTree *tree, idx_t node_idx, key_t key) {
+    if (node_idx == IDX_INVALID) {
+        idx_t new_idx = _snap_alloc(tree);
+        *_snap_node(tree, new_idx) = (SnapNode) {IDX_INVALID, IDX_INVALID, key, 1};
+        return new_idx;
+    }
+
+    idx_t copy = _snap_copy(tree, node_idx);
+    if (key < _snap_node(tree, copy)->key) {
+        idx_t child = _snap_insert_recursive(tree, _snap_node(tree, copy)->left, key);
+        _snap_node(tree, copy)->left = child;
+    } else {
+        idx_t child = _snap_insert_recursive(tree, _snap_node(tree, copy)->right, key);
+        _snap_node(tree, copy)->right = child;
+    }
+
+    SnapNode *node = _snap_node(tree, copy);
+    int height_left = _snap_height(tree, node->left);
+    int height_right = _snap_height(tree, node->right);
+    node->height = 1 + max(height_left, height_right);
+    int balance = height_left - height_right;
+
+    if (balance > 1) {
+        /* Left Right */
+        if (key > _snap_node(tree, node->left)->key)
+            node->left = _snap_rotate_left(tree, node->left);
+        /* Left Left */
+        return _snap_rotate_right(tree, copy);
+    }
+    if (balance < -1) {
+        /* Right Left */
+        if (key < _snap_node(tree, node->right)->key)
+            node->right = _snap_rotate_right(tree, node->right);
+        /* Right Right */
+        return _snap_rotate_left(tree, copy);
+    }
+    return copy;
+}
+
+/* Tudo o que foi retirado antes da menor época anunciada já não é alcançável
+ * por nenhum leitor: quem entrou depois só viu raízes mais novas */
+static void
+_snap_reclaim(SnapTree *tree) {
+    uint64_t oldest = __atomic_load_n(&tree->epoch, __ATOMIC_SEQ_CST);
+    for (int r = 0; r < SNAP_MAX_READERS; r++) {
+        uint64_t epoch = __atomic_load_n(&tree->readers[r].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+
+    size_t i = 0;
+    while (i < tree->retired_count && tree->retired[i].epoch < oldest) {
+        idx_t node = tree->retired[i].node;
+        _snap_node(tree, node)->left = tree->free_head;
+        tree->free_head = node;
+        i++;
+    }
+
+    /* o que sobra volta ao início da lista */
+    tree->retired_count -= i;
+    memmove(tree->retired, tree->retired + i, sizeof(SnapRetired) * tree->retired_count);
+}
+
+void
+tree_snap_insert(SnapTree *tree, key_t key) {
+    idx_t root = __atomic_load_n(&tree->root, __ATOMIC_RELAXED);
+    if (tree_snap_search(tree, root, key) != IDX_INVALID) return;
+
+    idx_t new_root = _snap_insert_recursive(tree, root, key);
+    __atomic_store_n(&tree->root, new_root, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&tree->epoch, 1, __ATOMIC_SEQ_CST);
+    tree->elements++;
+
+    if (tree->retired_count >= SNAP_RECLAIM_BATCH)
+        _snap_reclaim(tree);
+}
+
+void
+tree_snap_insert_arr(SnapTree *tree, const key_t *arr, size_t size) {
+    for (size_t k = 0; k < size; k++)
+        tree_snap_insert(tree, arr[k]);
+}
+
+/* A época é anunciada antes de ler a raiz: se o escritor não viu o anúncio,
+ * a raiz lida já é posterior a tudo o que ele reciclou */
+idx_t
+tree_snap_read_begin(SnapTree *tree, int reader) {
+    uint64_t epoch = __atomic_load_n(&tree->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&tree->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&tree->root, __ATOMIC_SEQ_CST);
+}
+
+void
+tree_snap_read_end(SnapTree *tree, int reader) {
+    __atomic_store_n(&tree->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+idx_t
+tree_snap_search(const SnapTree *tree, idx_t root, key_t key) {
+    idx_t current = root;
+    while (current != IDX_INVALID) {
+        const SnapNode *node = _snap_node(tree, current);
+        if (node->key == key) return current;
+        current = (key < node->key) ? node->left : node->right;
+    }
+    return IDX_INVALID;
+}
+
+static void*
+_snap_reader_thread(void *arg) {
+    SnapReaderArgs *args = (SnapReaderArgs*) arg;
+    size_t hits = 0;
+    size_t k = ((size_t) args->reader * 7919) % args->n;
+
+    double start = _wall_seconds();
+    for (size_t q = 0; q < SNAP_READER_LOOKUPS; q++) {
+        idx_t root = tree_snap_read_begin(args->tree, args->reader);
+        hits += (tree_snap_search(args->tree, root, args->keys[k]) != IDX_INVALID);
+        tree_snap_read_end(args->tree, args->reader);
+        if (++k == args->n) k = 0;
+    }
+    args->seconds = _wall_seconds() - start;
+
+    args->hits = hits;
+    return NULL;
+}
+
+/* Metade das chaves entra antes, a outra metade é inserida pelo escritor
+ * enquanto os leitores fazem SNAP_READER_LOOKUPS pesquisas cada um. Cada leitor
+ * mede o seu tempo de parede (clock() somaria o CPU de todas as threads) e o
+ * débito é sobre o leitor mais lento, sem contar o que o escritor demora */
+void
+snap_test_and_log(key_t* arr, FILE *fptr) {
+
+    size_t half = g_treesize / 2;
+    if (g_treesize == 0) return;
+
+    for (int threads = 1; threads <= SNAP_MAX_READERS; threads *= 2) {
+        SnapTree tree = tree_snap_create();
+        tree_snap_insert_arr(&tree, arr, half);
+
+        pthread_t tid[SNAP_MAX_READERS];
+        SnapReaderArgs args[SNAP_MAX_READERS];
+
+        for (int t = 0; t < threads; t++) {
+            args[t] = (SnapReaderArgs) {&tree, arr, g_treesize, t, 0, 0};
+            if (pthread_create(&tid[t], NULL, _snap_reader_thread, &args[t]) != 0) {
+                perror("Failed to create reader thread.");
+                exit(EXIT_FAILURE);
+            }
+        }
+        tree_snap_insert_arr(&tree, arr + half, g_treesize - half);
+        double seconds = 0;
+        for (int t = 0; t < threads; t++) {
+            pthread_join(tid[t], NULL);
+            if (args[t].seconds > seconds) seconds = args[t].seconds;
+        }
+
+        fprintf(fptr, "%d readers = %0.2lfMops/s\t", threads,
+                (double) threads * SNAP_READER_LOOKUPS / seconds / 1e6);
+
+        if (threads == SNAP_MAX_READERS) {
+            fprintf(fptr, "(%u keys, %u slots, %zu retired)\n",
+                    tree.elements, tree.next_slot, tree.retired_count);
+        }
+        tree_snap_destroy(&tree);
+    }
+}
+
+/* ===== LOCK-FREE SKIP LIST ===== */
+
+/* Em média cada nó gasta 2 palavras de cabeçalho e 2 de torre, 5 por chave
+ * deixa folga para a variância */
+SkipList
+tree_skiplist_create(idx_t expected_keys) {
+    SkipList list;
+    uint64_t capacity = (uint64_t) expected_keys * 5 + 1024 + 2 + SKIP_MAX_LEVEL;
+    if (capacity >= IDX_INVALID) {
+        perror("Skip list exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+
+    list.words = (idx_t*) malloc(sizeof(idx_t) * capacity);
+    if (list.words == NULL) {
+        perror("Failed to allocate skip list.");
+        exit(EXIT_FAILURE);
+    }
+    list.capacity = capacity;
+    list.used = 2 + SKIP_MAX_LEVEL;
+    list.head = 0;
+    list.elements = 0;
+
+    SkipNode *head = _skip_node(&list, list.head);
+    head->key = INT32_MIN;
+    head->level = SKIP_MAX_LEVEL;
+    for (int l = 0; l < SKIP_MAX_LEVEL; l++) head->next[l] = IDX_INVALID;
+    return list;
+}
+
+void
+tree_skiplist_destroy(SkipList *list) {
+    free(list->words);
+}
+
+static inline SkipNode*
+_skip_node(const SkipList *list, idx_t offset) {
+    return (SkipNode*) (list->words + offset);
+}
+
+/* preds[l] é o último nó com chave < key no nível l, succs[l] o seguinte.
+ * As leituras de next são acquire para ver a chave e a torre de quem o ligou */
+static int
+_skip_find(SkipList *list, key_t key, idx_t *preds, idx_t *succs) {
+    idx_t x = list->head;
+    for (int l = SKIP_MAX_LEVEL - 1; l >= 0; l--) {
+        idx_t next = __atomic_load_n(&_skip_node(list, x)->next[l], __ATOMIC_ACQUIRE);
+        while (next != IDX_INVALID && _skip_node(list, next)->key < key) {
+            x = next;
+            next = __atomic_load_n(&_skip_node(list, x)->next[l], __ATOMIC_ACQUIRE);
+        }
+        preds[l] = x;
+        succs[l] = next;
+    }
+    return succs[0] != IDX_INVALID && _skip_node(list, succs[0])->key == key;
+}
+
+/* O nó entra na lista quando o CAS do nível 0 passa; os níveis de cima são só
+ * atalhos e ligam-se depois, um a um, voltando a procurar se outro escritor
+ * mudou o predecessor. Se outra thread ganhar a mesma chave a torre fica perdida
+ * no arena */
+int
+tree_skiplist_insert(SkipList *list, key_t key, idx_t *rng) {
+    idx_t preds[SKIP_MAX_LEVEL], succs[SKIP_MAX_LEVEL];
+    if (_skip_find(list, key, preds, succs)) return 0;
+
+    idx_t level = 1 + __builtin_ctz(xorshift_next(rng) | (1u << (SKIP_MAX_LEVEL - 1)));
+    idx_t offset = __atomic_fetch_add(&list->used, 2 + level, __ATOMIC_RELAXED);
+    if ((uint64_t) offset + 2 + level > list->capacity) {
+        perror("Skip list arena is full.");
+        exit(EXIT_FAILURE);
+    }
+
+    SkipNode *node = _skip_node(list, offset);
+    node->key = key;
+    node->level = level;
+
+    for (;;) {
+        for (idx_t l = 0; l < level; l++)
+            node->next[l] = succs[l];
+        idx_t expected = succs[0];
+        if (__atomic_compare_exchange_n(&_skip_node(list, preds[0])->next[0], &expected, offset,
+                                        0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            break;
+        if (_skip_find(list, key, preds, succs)) return 0;
+    }
+
+    for (idx_t l = 1; l < level; l++) {
+        for (;;) {
+            __atomic_store_n(&node->next[l], succs[l], __ATOMIC_RELAXED);
+            idx_t expected = succs[l];
+            if (__atomic_compare_exchange_n(&_skip_node(list, preds[l])->next[l], &expected, offset,
+                                            0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                break;
+            _skip_find(list, key, preds, succs);
+        }
+    }
+
+    __atomic_add_fetch(&list->elements, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+idx_t
+tree_skiplist_search(SkipList *list, key_t key) {
+    idx_t x = list->head;
+    idx_t next = IDX_INVALID;
+    for (int l = SKIP_MAX_LEVEL - 1; l >= 0; l--) {
+        next = __atomic_load_n(&_skip_node(list, x)->next[l], __ATOMIC_ACQUIRE);
+        while (next != IDX_INVALID && _skip_node(list, next)->key < key) {
+            x = next;
+            next = __atomic_load_n(&_skip_node(list, x)->next[l], __ATOMIC_ACQUIRE);
+        }
+    }
+    return (next != IDX_INVALID && _skip_node(list, next)->key == key) ? next : IDX_INVALID;
+}
+
+/* Como tree_avl_search_batch: cada pista dá um passo por volta (avançar no
+ * nível ou descer um nível). A pista guarda já o candidato seguinte e pede a
+ * sua chave com prefetch, que é a leitura que falha na cache */
+void
+tree_skiplist_search_batch(SkipList *list, const key_t *keys, size_t n, idx_t *out_idx) {
+    idx_t current[SEARCH_GROUP];
+    idx_t candidate[SEARCH_GROUP];
+    int level[SEARCH_GROUP];
+    size_t lane[SEARCH_GROUP];
+    size_t next_key = 0;
+    int active = 0;
+    SkipNode *head = _skip_node(list, list->head);
+
+    /* os níveis vazios no topo da sentinela não levam a lado nenhum */
+    int top = SKIP_MAX_LEVEL - 1;
+    while (top > 0 && __atomic_load_n(&head->next[top], __ATOMIC_ACQUIRE) == IDX_INVALID) top--;
+    idx_t top_first = __atomic_load_n(&head->next[top], __ATOMIC_ACQUIRE);
+
+    while (active < SEARCH_GROUP && next_key < n) {
+        lane[active] = next_key++;
+        level[active] = top;
+        current[active] = list->head;
+        candidate[active++] = top_first;
+    }
+
+    while (active > 0) {
+        for (int g = 0; g < active; ) {
+            key_t key = keys[lane[g]];
+            idx_t next = candidate[g];
+
+            if (next != IDX_INVALID && _skip_node(list, next)->key < key) {
+                current[g] = next;
+            } else if (level[g] > 0) {
+                level[g]--;
+            } else {
+                out_idx[lane[g]] = (next != IDX_INVALID && _skip_node(list, next)->key == key) ? next : IDX_INVALID;
+                if (next_key < n) {
+                    lane[g] = next_key++;
+                    level[g] = top;
+                    current[g] = list->head;
+                    candidate[g] = top_first;
+                    g++;
+                } else {
+                    active--;
+                    lane[g] = lane[active];
+                    level[g] = level[active];
+                    current[g] = current[active];
+                    candidate[g] = candidate[active];
+                }
+                continue;
+            }
+
+            candidate[g] = __atomic_load_n(&_skip_node(list, current[g])->next[level[g]], __ATOMIC_ACQUIRE);
+            if (candidate[g] != IDX_INVALID)
+                __builtin_prefetch(_skip_node(list, candidate[g]));
+            g++;
+        }
+    }
+}
+
+static void*
+_skip_writer_thread(void *arg) {
+    SkipWriterArgs *args = (SkipWriterArgs*) arg;
+    for (size_t k = args->begin; k < args->end; k++)
+        tree_skiplist_insert(args->list, args->keys[k], &args->rng);
+    return NULL;
+}
+
+/* Cada thread insere uma fatia contígua do conjunto. Tempo de parede, e as
+ * inserções single-thread da RB e da Treap no mesmo conjunto para comparar */
+void
+skiplist_test_and_log(key_t* arr, FILE *fptr) {
+
+    clock_t start = 0, end = 0;
+    clock_t total_rb = 0, total_treap = 0, total_search = 0, total_batch = 0;
+    double ops = (double) g_treesize * g_average;
+    if (g_treesize == 0) return;
+
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        RBTree rb = tree_rb_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_rb_insert(&rb, arr[idx]);
+        end = clock();
+        total_rb += (end-start);
+        tree_rb_destroy(&rb);
+
+        start = clock();
+        Treap treap = tree_treap_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_treap_insert(&treap, arr[idx]);
+        end = clock();
+        total_treap += (end-start);
+        tree_treap_destroy(&treap);
+    }
+    fprintf(fptr, "RB = %0.2lfMops/s\tTREAP = %0.2lfMops/s\tSkip list",
+            ops / ((double) (total_rb ? total_rb : 1) / CLOCKS_PER_SEC) / 1e6,
+            ops / ((double) (total_treap ? total_treap : 1) / CLOCKS_PER_SEC) / 1e6);
+
+    idx_t elements = 0;
+    idx_t *out_idx = malloc(sizeof(idx_t) * (g_treesize + 1));
+    for (int threads = 1; threads <= SKIP_MAX_THREADS; threads *= 2) {
+        double seconds = 0;
+        for (int i = 0; i < g_average; i++) {
+            SkipList list = tree_skiplist_create(g_treesize);
+            pthread_t tid[SKIP_MAX_THREADS];
+            SkipWriterArgs args[SKIP_MAX_THREADS];
+            struct timespec wall_start, wall_end;
+
+            clock_gettime(CLOCK_MONOTONIC, &wall_start);
+            for (int t = 0; t < threads; t++) {
+                args[t] = (SkipWriterArgs) {&list, arr, (size_t) g_treesize * t / threads,
+                                            (size_t) g_treesize * (t + 1) / threads, SEED + t};
+                if (pthread_create(&tid[t], NULL, _skip_writer_thread, &args[t]) != 0) {
+                    perror("Failed to create writer thread.");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (int t = 0; t < threads; t++)
+                pthread_join(tid[t], NULL);
+            clock_gettime(CLOCK_MONOTONIC, &wall_end);
+            seconds += (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+            elements = list.elements;
+
+            /* pesquisas só uma vez, com a lista de uma thread */
+            if (threads == 1) {
+                start = clock();
+                for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+                    out_idx[idx] = tree_skiplist_search(&list, arr[idx]);
+                end = clock();
+                total_search += (end-start);
+
+                start = clock();
+                tree_skiplist_search_batch(&list, arr, g_treesize, out_idx);
+                end = clock();
+                total_batch += (end-start);
+            }
+            tree_skiplist_destroy(&list);
+        }
+        fprintf(fptr, " %dT = %0.2lfMops/s", threads, ops / (seconds > 0 ? seconds : 1e-9) / 1e6);
+    }
+    free(out_idx);
+
+    double ns = 1e9 / CLOCKS_PER_SEC / ops;
+    fprintf(fptr, "\tsearch = %0.1lfns (batch %0.1lfns)\t(%u keys)\n", total_search*ns, total_batch*ns, elements);
+}
+
+/* ===== FORK-JOIN POOL ===== */
+
+ForkJoinPool*
+forkjoin_create(int nthreads) {
+    ForkJoinPool *pool = (ForkJoinPool*) malloc(sizeof(ForkJoinPool));
+    if (pool == NULL) {
+        perror("Failed to allocate fork-join pool.");
+        exit(EXIT_FAILURE);
+    }
+    pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * (nthreads > 0 ? nthreads : 1));
+    if (pool->threads == NULL) {
+        perror("Failed to allocate fork-join pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->nthreads = nthreads;
+    pool->top = 0;
+    pool->stop = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (int t = 0; t < nthreads; t++) {
+        if (pthread_create(&pool->threads[t], NULL, _forkjoin_worker, pool) != 0) {
+            perror("Failed to create pool thread.");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void
+forkjoin_destroy(ForkJoinPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t = 0; t < pool->nthreads; t++)
+        pthread_join(pool->threads[t], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->threads);
+    free(pool);
+}
+
+/* O release publica as escritas da tarefa a quem a vir acabada no join */
+static void
+_forkjoin_run(ForkJoinTask *task) {
+    task->run(task->arg);
+    __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+static void*
+_forkjoin_worker(void *arg) {
+    ForkJoinPool *pool = (ForkJoinPool*) arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->top == 0)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->top == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        ForkJoinTask *task = pool->pending[--pool->top];
+        pthread_mutex_unlock(&pool->lock);
+        _forkjoin_run(task);
+    }
+}
+
+void
+forkjoin_fork(ForkJoinPool *pool, ForkJoinTask *task) {
+    task->done = 0;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->top < FORKJOIN_MAX_PENDING) {
+        pool->pending[pool->top++] = task;
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    _forkjoin_run(task);
+}
+
+/* Nunca bloqueia à espera de outra thread: ou ajuda com uma tarefa pendente
+ * ou cede o CPU, por isso forks encaixados não fazem deadlock */
+void
+forkjoin_join(ForkJoinPool *pool, ForkJoinTask *task) {
+    while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&pool->lock);
+        ForkJoinTask *other = (pool->top > 0) ? pool->pending[--pool->top] : NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (other != NULL) _forkjoin_run(other);
+        else sched_yield();
+    }
+}
+
+/* ===== TREAP SPLIT / MERGE ===== */
+
+/* Parte a subárvore root em chaves < key (less) e > key (greater). O nó com a
+ * chave, se existir, fica de fora e sem filhos e é o valor devolvido */
+idx_t
+tree_treap_split(Treap *treap, idx_t root, key_t key, idx_t *less, idx_t *greater) {
+    if (root == IDX_INVALID) {
+        *less = IDX_INVALID;
+        *greater = IDX_INVALID;
+        return IDX_INVALID;
+    }
+
+    TreapNode *nodes = treap->nodes;
+    idx_t found;
+    if (nodes[root].key < key) {
+        found = tree_treap_split(treap, nodes[root].right, key, &nodes[root].right, greater);
+        *less = root;
+    } else if (nodes[root].key > key) {
+        found = tree_treap_split(treap, nodes[root].left, key, less, &nodes[root].left);
+        *greater = root;
+    } else {
+        *less = nodes[root].left;
+        *greater = nodes[root].right;
+        nodes[root].left = IDX_INVALID;
+        nodes[root].right = IDX_INVALID;
+        found = root;
+    }
+    _treap_update_size(treap, root);
+    return found;
+}
+
+idx_t
+tree_treap_merge(Treap *treap, idx_t less, idx_t greater) {
+    if (less == IDX_INVALID) return greater;
+    if (greater == IDX_INVALID) return less;
+
+    TreapNode *nodes = treap->nodes;
+    if (nodes[less].priority > nodes[greater].priority) {
+        nodes[less].right = tree_treap_merge(treap, nodes[less].right, greater);
+        _treap_update_size(treap, less);
+        return less;
+    }
+    nodes[greater].left = tree_treap_merge(treap, less, nodes[greater].left);
+    _treap_update_size(treap, greater);
+    return greater;
+}
+
+/* Copia o arena de other para o fim do de treap, com os índices deslocados,
+ * para as operações poderem ligar nós das duas. Os slots livres de other
+ * passam para a lista de treap. Devolve a raiz de other no novo arena */
+static idx_t
+_treap_absorb(Treap *treap, Treap *other) {
+    idx_t offset = treap->elements;
+    uint64_t needed = (uint64_t) offset + other->elements;
+    if (needed >= IDX_INVALID) {
+        perror("Treap exceeded maximum capacity.");
+        exit(EXIT_FAILURE);
+    }
+    if (needed > treap->capacity) {
+        TreapNode *new_nodes = (TreapNode*) realloc(treap->nodes, sizeof(TreapNode) * needed);
+        if (new_nodes == NULL) {
+            perror("Failed to realloc new nodes.");
+            exit(EXIT_FAILURE);
+        }
+        treap->nodes = new_nodes;
+        treap->capacity = needed;
+    }
+
+    TreapNode *moved = treap->nodes + offset;
+    for (idx_t i = 0; i < other->elements; i++) {
+        TreapNode node = other->nodes[i];
+        if (node.left != IDX_INVALID) node.left += offset;
+        if (node.right != IDX_INVALID) node.right += offset;
+        moved[i] = node;
+    }
+
+    if (other->free_head != IDX_INVALID) {
+        idx_t tail = other->free_head + offset;
+        while (treap->nodes[tail].left != IDX_INVALID) tail = treap->nodes[tail].left;
+        treap->nodes[tail].left = treap->free_head;
+        treap->free_head = other->free_head + offset;
+    }
+
+    idx_t root = (other->tree_root == IDX_INVALID) ? IDX_INVALID : other->tree_root + offset;
+    treap->elements = needed;
+
+    tree_treap_destroy(other);
+    other->nodes = NULL;
+    other->tree_root = IDX_INVALID;
+    other->free_head = IDX_INVALID;
+    return root;
+}
+
+/* Operações por join: a raiz de maior prioridade (a de a, na diferença) parte a
+ * outra árvore pela sua chave e os dois lados resolvem-se sem se tocarem, em
+ * O(m log(n/m + 1)). Os nós que saem do resultado não voltam à lista de livres
+ * (seriam subárvores inteiras a percorrer); tree_treap_compact recupera-os */
+static idx_t
+_treap_set_op(Treap *treap, ForkJoinPool *pool, int op, idx_t a, idx_t b, size_t estimate) {
+    if (a == IDX_INVALID) return (op == TREAP_SET_UNION) ? b : IDX_INVALID;
+    if (b == IDX_INVALID) return (op == TREAP_SET_INTERSECT) ? IDX_INVALID : a;
+
+    TreapNode *nodes = treap->nodes;
+    if (op != TREAP_SET_DIFFERENCE && nodes[a].priority < nodes[b].priority) {
+        idx_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    idx_t b_less, b_greater;
+    idx_t found = tree_treap_split(treap, b, nodes[a].key, &b_less, &b_greater);
+    idx_t left, right;
+
+    estimate /= 2;
+    if (pool != NULL && estimate > TREAP_SET_GRAIN) {
+        TreapSetTask side = {{_treap_set_task_run, &side, 0}, treap, pool, op,
+                             nodes[a].left, b_less, estimate, IDX_INVALID};
+        forkjoin_fork(pool, &side.task);
+        right = _treap_set_op(treap, pool, op, nodes[a].right, b_greater, estimate);
+        forkjoin_join(pool, &side.task);
+        left = side.result;
+    } else {
+        left = _treap_set_op(treap, pool, op, nodes[a].left, b_less, estimate);
+        right = _treap_set_op(treap, pool, op, nodes[a].right, b_greater, estimate);
+    }
+
+    /* a união fica sempre com a; a interseção só se a chave estava nas duas,
+     * a diferença só se não estava */
+    int keep = (op == TREAP_SET_UNION) || ((found != IDX_INVALID) == (op == TREAP_SET_INTERSECT));
+    if (!keep) return tree_treap_merge(treap, left, right);
+
+    nodes[a].left = left;
+    nodes[a].right = right;
+    _treap_update_size(treap, a);
+    return a;
+}
+
+static void
+_treap_set_task_run(void *arg) {
+    TreapSetTask *side = (TreapSetTask*) arg;
+    side->result = _treap_set_op(side->treap, side->pool, side->op, side->a, side->b, side->estimate);
+}
+
+static void
+_treap_set(Treap *treap, Treap *other, ForkJoinPool *pool, int op) {
+    size_t estimate = (size_t) treap->elements + other->elements;
+    idx_t other_root = _treap_absorb(treap, other);
+    treap->tree_root = _treap_set_op(treap, pool, op, treap->tree_root, other_root, estimate);
+}
+
+void
+tree_treap_union(Treap *treap, Treap *other, ForkJoinPool *pool) {
+    _treap_set(treap, other, pool, TREAP_SET_UNION);
+}
+
+void
+tree_treap_intersect(Treap *treap, Treap *other, ForkJoinPool *pool) {
+    _treap_set(treap, other, pool, TREAP_SET_INTERSECT);
+}
+
+void
+tree_treap_difference(Treap *treap, Treap *other, ForkJoinPool *pool) {
+    _treap_set(treap, other, pool, TREAP_SET_DIFFERENCE);
+}
+
+static Treap
+_treap_clone(const Treap *treap) {
+    Treap clone = *treap;
+    clone.nodes = (TreapNode*) malloc(sizeof(TreapNode) * treap->capacity);
+    if (clone.nodes == NULL) {
+        perror("Failed to allocate Treap.");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(clone.nodes, treap->nodes, sizeof(TreapNode) * treap->capacity);
+    return clone;
+}
+
+static double
+_wall_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* A = primeiros 3/4 do conjunto, B = últimos 3/4 (metade em comum). União de B
+ * em A contra inserir as chaves de B em A, sem e com o pool; depois interseção e
+ * diferença com o pool. Tempo de parede, as árvores de partida não contam */
+void
+treap_set_test_and_log(key_t* arr, FILE *fptr) {
+
+    size_t quarter = g_treesize / 4;
+    size_t a_size = g_treesize - quarter;
+    if (g_treesize == 0) return;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = (cpus > 1) ? (int) cpus - 1 : 1; // quem faz fork também trabalha
+    ForkJoinPool *pool = forkjoin_create(nthreads);
+
+    double total_insert = 0, total_union = 0, total_union_pool = 0;
+    double total_intersect = 0, total_difference = 0;
+    idx_t union_keys = 0, intersect_keys = 0, difference_keys = 0;
+
+    for (int i = 0; i < g_average; i++) {
+        Treap a = tree_treap_create(10), b = tree_treap_create(10);
+        for (size_t k = 0; k < a_size; k++) tree_treap_insert(&a, arr[k]);
+        for (size_t k = quarter; k < (size_t) g_treesize; k++) tree_treap_insert(&b, arr[k]);
+
+        Treap target = _treap_clone(&a);
+        double start = _wall_seconds();
+        for (size_t k = quarter; k < (size_t) g_treesize; k++) tree_treap_insert(&target, arr[k]);
+        total_insert += _wall_seconds() - start;
+        tree_treap_destroy(&target);
+
+        Treap ops[4];
+        void (*set_op[4])(Treap*, Treap*, ForkJoinPool*) = {
+            tree_treap_union, tree_treap_union, tree_treap_intersect, tree_treap_difference
+        };
+        double *total[4] = {&total_union, &total_union_pool, &total_intersect, &total_difference};
+        idx_t *keys[4] = {&union_keys, &union_keys, &intersect_keys, &difference_keys};
+
+        for (int op = 0; op < 4; op++) {
+            ops[op] = _treap_clone(&a);
+            Treap other = _treap_clone(&b);
+            start = _wall_seconds();
+            set_op[op](&ops[op], &other, (op == 0) ? NULL : pool);
+            *total[op] += _wall_seconds() - start;
+
+            tree_treap_compact(&ops[op]);
+            *keys[op] = ops[op].elements;
+            tree_treap_destroy(&ops[op]);
+        }
+
+        tree_treap_destroy(&a);
+        tree_treap_destroy(&b);
+    }
+    forkjoin_destroy(pool);
+
+    double ms = 1e3 / g_average;
+    fprintf(fptr, "INSERT = %0.2lfms\tUNION = %0.2lfms (%d threads %0.2lfms)\t(%u keys)\t"
+            "INTERSECT = %0.2lfms (%u keys)\tDIFFERENCE = %0.2lfms (%u keys)\n",
+            total_insert*ms, total_union*ms, nthreads + 1, total_union_pool*ms, union_keys,
+            total_intersect*ms, intersect_keys, total_difference*ms, difference_keys);
+}
+
+/* ===== CURSOR ===== */
+
+#define CURSOR_IDX(cur, i, offset) (*(const idx_t*) ((cur)->nodes + (cur)->stride*(i) + (offset)))
+#define CURSOR_KEY(cur, i) (*(const key_t*) ((cur)->nodes + (cur)->stride*(i) + (cur)->key_offset))
+
+TreeCursor
+tree_avl_cursor(AVLTree *avl) {
+    TreeCursor cur;
+    cur.nodes = (const char*) avl->nodes;
+    cur.stride = sizeof(AVLNode);
+    cur.key_offset = offsetof(AVLNode, key);
+    cur.left_offset = offsetof(AVLNode, left);
+    cur.right_offset = offsetof(AVLNode, right);
+    cur.root = (avl->elements == 0) ? IDX_INVALID : avl->tree_root;
+    cur.current = IDX_INVALID;
+    cur.depth = 0;
+    cur.overflow = 0;
+    return cur;
+}
+
+TreeCursor
+tree_rb_cursor(RBTree *tree) {
+    TreeCursor cur;
+    cur.nodes = (const char*) tree->nodes;
+    cur.stride = sizeof(RBNode);
+    cur.key_offset = offsetof(RBNode, key);
+    cur.left_offset = offsetof(RBNode, left);
+    cur.right_offset = offsetof(RBNode, right);
+    cur.root = tree->tree_root;
+    cur.current = IDX_INVALID;
+    cur.depth = 0;
+    cur.overflow = 0;
+    return cur;
+}
+
+TreeCursor
+tree_treap_cursor(Treap *treap) {
+    TreeCursor cur;
+    cur.nodes = (const char*) treap->nodes;
+    cur.stride = sizeof(TreapNode);
+    cur.key_offset = offsetof(TreapNode, key);
+    cur.left_offset = offsetof(TreapNode, left);
+    cur.right_offset = offsetof(TreapNode, right);
+    cur.root = treap->tree_root;
+    cur.current = IDX_INVALID;
+    cur.depth = 0;
+    cur.overflow = 0;
+    return cur;
+}
+
+/* dir > 0: primeira chave >= key (> com strict). dir < 0: última <= key (<).
+ * O caminho é guardado na descida e cortado no último candidato */
+static int
+_cursor_seek(TreeCursor *cur, key_t key, int dir, int strict) {
+    size_t toward = (dir > 0) ? cur->left_offset : cur->right_offset;
+    size_t away = (dir > 0) ? cur->right_offset : cur->left_offset;
+    idx_t node = cur->root;
+    idx_t candidate = IDX_INVALID;
+    int depth = 0, candidate_depth = 0;
+
+    while (node != IDX_INVALID) {
+        if (depth < TREE_MAX_DEPTH) cur->path[depth] = node;
+        depth++;
+
+        key_t node_key = CURSOR_KEY(cur, node);
+        int hit = (dir > 0) ? (strict ? node_key > key : node_key >= key)
+                            : (strict ? node_key < key : node_key <= key);
+        if (hit) {
+            candidate = node;
+            candidate_depth = depth;
+            node = CURSOR_IDX(cur, node, toward);
+        } else {
+            node = CURSOR_IDX(cur, node, away);
+        }
+    }
+
+    cur->current = candidate;
+    cur->depth = candidate_depth;
+    cur->overflow = (candidate_depth > TREE_MAX_DEPTH);
+    return candidate != IDX_INVALID;
+}
+
+/* Sucessor (dir > 0) ou antecessor: desce pelo filho desse lado até ao extremo
+ * oposto, ou sobe enquanto se vem desse lado. Amortizado O(1) */
+static int
+_cursor_step(TreeCursor *cur, int dir) {
+    if (cur->current == IDX_INVALID) return 0;
+    if (cur->overflow) return _cursor_seek(cur, CURSOR_KEY(cur, cur->current), dir, 1);
+
+    size_t near = (dir > 0) ? cur->right_offset : cur->left_offset;
+    size_t far = (dir > 0) ? cur->left_offset : cur->right_offset;
+
+    idx_t node = CURSOR_IDX(cur, cur->current, near);
+    if (node != IDX_INVALID) {
+        int depth = cur->depth;
+        while (node != IDX_INVALID) {
+            if (depth == TREE_MAX_DEPTH)
+                return _cursor_seek(cur, CURSOR_KEY(cur, cur->current), dir, 1);
+            cur->path[depth++] = node;
+            node = CURSOR_IDX(cur, node, far);
+        }
+        cur->depth = depth;
+        cur->current = cur->path[depth-1];
+        return 1;
+    }
+
+    int d = cur->depth - 1;
+    while (d > 0 && CURSOR_IDX(cur, cur->path[d-1], near) == cur->path[d])
+        d--;
+    if (d == 0) {
+        cur->current = IDX_INVALID;
+        cur->depth = 0;
+        return 0;
+    }
+    cur->depth = d;
+    cur->current = cur->path[d-1];
+    return 1;
+}
+
+int
+tree_cursor_first(TreeCursor *cur) {
+    return _cursor_seek(cur, INT32_MIN, 1, 0);
+}
+
+int
+tree_cursor_last(TreeCursor *cur) {
+    return _cursor_seek(cur, INT32_MAX, -1, 0);
+}
+
+int
+tree_cursor_lower_bound(TreeCursor *cur, key_t key) {
+    return _cursor_seek(cur, key, 1, 0);
+}
+
+int
+tree_cursor_upper_bound(TreeCursor *cur, key_t key) {
+    return _cursor_seek(cur, key, 1, 1);
+}
+
+int
+tree_cursor_next(TreeCursor *cur) {
+    return _cursor_step(cur, 1);
+}
+
+int
+tree_cursor_prev(TreeCursor *cur) {
+    return _cursor_step(cur, -1);
+}
+
+key_t
+tree_cursor_key(const TreeCursor *cur) {
+    return CURSOR_KEY(cur, cur->current);
+}
+
+/* O(log n + k): lower_bound e depois next até passar hi. O cursor fica na
+ * primeira chave > hi */
+size_t
+tree_cursor_range_count(TreeCursor *cur, key_t lo, key_t hi) {
+    size_t count = 0;
+    if (lo > hi) return 0;
+    for (int ok = tree_cursor_lower_bound(cur, lo); ok && tree_cursor_key(cur) <= hi; ok = tree_cursor_next(cur))
+        count++;
+    return count;
+}
+
+/* Percursos em ordem sem recursão, a altura da AVL e da RB cabe em TREE_MAX_DEPTH */
+size_t
+tree_avl_sorted_keys(AVLTree *avl, key_t *out) {
+    idx_t stack[TREE_MAX_DEPTH];
+    int top = 0;
+    size_t count = 0;
+    idx_t current = (avl->elements == 0) ? IDX_INVALID : avl->tree_root;
+
+    while (current != IDX_INVALID || top > 0) {
+        while (current != IDX_INVALID) {
+            stack[top++] = current;
+            current = avl->nodes[current].left;
+        }
+        current = stack[--top];
+        out[count++] = avl->nodes[current].key;
+        current = avl->nodes[current].right;
+    }
+    return count;
+}
+
+size_t
+tree_rb_sorted_keys(RBTree *tree, key_t *out) {
+    idx_t stack[TREE_MAX_DEPTH];
+    int top = 0;
+    size_t count = 0;
+    idx_t current = tree->tree_root;
+
+    while (current != IDX_INVALID || top > 0) {
+        while (current != IDX_INVALID) {
+            stack[top++] = current;
+            current = tree->nodes[current].left;
+        }
+        current = stack[--top];
+        out[count++] = tree->nodes[current].key;
+        current = tree->nodes[current].right;
+    }
+    return count;
+}
+
+/* A altura da Treap não tem limite fixo, a pilha vai para o heap */
+size_t
+tree_treap_sorted_keys(Treap *treap, key_t *out) {
+    idx_t *stack = (idx_t*) malloc(sizeof(idx_t) * (treap->elements + 1));
+    if (stack == NULL) {
+        perror("Failed to allocate traversal stack.");
+        exit(EXIT_FAILURE);
+    }
+    idx_t top = 0;
+    size_t count = 0;
+    idx_t current = treap->tree_root;
+
+    while (current != IDX_INVALID || top > 0) {
+        while (current != IDX_INVALID) {
+            stack[top++] = current;
+            current = treap->nodes[current].left;
+        }
+        current = stack[--top];
+        out[count++] = treap->nodes[current].key;
+        current = treap->nodes[current].right;
+    }
+    free(stack);
+    return count;
+}
+
+/* Em ordem pela árvore implícita, a k-ésima chave vai para a posição visitada */
+static void
+_eytz_fill(EytzTree *eytz, const key_t *sorted, size_t *k, idx_t i) {
+    if (i > eytz->elements) return;
+    _eytz_fill(eytz, sorted, k, 2*i);
+    eytz->keys[i] = sorted[(*k)++];
+    _eytz_fill(eytz, sorted, k, 2*i + 1);
+}
+
+EytzTree
+tree_eytz_freeze(const key_t *sorted, idx_t n) {
+    EytzTree eytz = {NULL, n};
+
+    /* alinhado a 64 bytes: os 16 descendentes de i a 4 níveis ficam numa só linha */
+    if (posix_memalign((void**) &eytz.keys, 64, sizeof(key_t) * ((size_t) n + 1)) != 0) {
+        perror("Failed to allocate Eytzinger tree.");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t k = 0;
+    _eytz_fill(&eytz, sorted, &k, 1);
+    return eytz;
+}
+
+void
+tree_eytz_destroy(EytzTree *eytz) {
+    free(eytz->keys);
+    eytz->keys = NULL;
+    eytz->elements = 0;
+}
+
+/* Sem ramos: desce sempre até sair da árvore, guardando nos bits de i o caminho.
+ * O último passo à direita seguido de só passos à esquerda é o menor >= key */
+idx_t
+tree_eytz_search(EytzTree *eytz, key_t key) {
+    const key_t *keys = eytz->keys;
+    idx_t n = eytz->elements;
+    uint64_t i = 1;
+
+    while (i <= n) {
+        __builtin_prefetch(keys + 16*i);
+        i = 2*i + (keys[i] < key);
+    }
+    i >>= __builtin_ctzll(~i) + 1;
+
+    return (i != 0 && keys[i] == key) ? (idx_t) i : IDX_INVALID;
+}
+
+/* Todas as descidas têm o mesmo número de passos (±1), por isso anda o grupo
+ * inteiro em passo certo */
+void
+tree_eytz_search_batch(EytzTree *eytz, const key_t *keys, size_t n, idx_t *out_idx) {
+    const key_t *tree_keys = eytz->keys;
+    idx_t elements = eytz->elements;
+    uint64_t i[SEARCH_GROUP];
+
+    for (size_t base = 0; base < n; base += SEARCH_GROUP) {
+        int group = (n - base < SEARCH_GROUP) ? (int) (n - base) : SEARCH_GROUP;
+        int active = group;
+
+        for (int g = 0; g < group; g++) i[g] = 1;
+
+        while (active > 0) {
+            active = 0;
+            for (int g = 0; g < group; g++) {
+                if (i[g] > elements) continue;
+                i[g] = 2*i[g] + (tree_keys[i[g]] < keys[base + g]);
+                __builtin_prefetch(tree_keys + 16*i[g]);
+                active++;
+            }
+        }
+
+        for (int g = 0; g < group; g++) {
+            uint64_t j = i[g] >> (__builtin_ctzll(~i[g]) + 1);
+            out_idx[base + g] = (j != 0 && tree_keys[j] == keys[base + g]) ? (idx_t) j : IDX_INVALID;
+        }
+    }
+}
+
+/* Só depende da forma, todas as árvores de baixo à mesma profundidade são iguais */
+static void
+_veb_levels(VebTree *veb, int depth, int height) {
+    if (height <= 1) return;
+
+    int bottom = height / 2;
+    int top = height - bottom;
+    VebLevel *level = &veb->level[depth + top];
+    level->top_size = ((idx_t) 1 << top) - 1;
+    level->bottom_size = ((idx_t) 1 << bottom) - 1;
+    level->top_depth = depth;
+
+    _veb_levels(veb, depth, top);
+    _veb_levels(veb, depth + top, bottom);
+}
+
+/* i é o índice BFS (a partir de 1) e pos[d] a posição vEB do antecessor à profundidade d.
+ * A árvore de baixo onde cai i é dada pelos últimos top bits de i */
+static void
+_veb_fill(VebTree *veb, const key_t *sorted, idx_t *pos, idx_t i, int depth) {
+    if (depth == 0) {
+        pos[0] = 0;
+    } else {
+        VebLevel level = veb->level[depth];
+        pos[depth] = pos[level.top_depth] + level.top_size + (i & level.top_size) * level.bottom_size;
+    }
+
+    /* posição em ordem do nó i numa árvore perfeita */
+    idx_t first = (idx_t) 1 << depth;
+    uint64_t rank = ((uint64_t) (i - first) * 2 + 1) * ((uint64_t) 1 << (veb->height - 1 - depth)) - 1;
+    veb->keys[pos[depth]] = sorted[(rank < veb->elements) ? rank : veb->elements - 1];
+
+    if (depth + 1 < veb->height) {
+        _veb_fill(veb, sorted, pos, 2*i, depth + 1);
+        _veb_fill(veb, sorted, pos, 2*i + 1, depth + 1);
+    }
+}
+
+VebTree
+tree_veb_freeze(const key_t *sorted, idx_t n) {
+    VebTree veb;
+    memset(&veb, 0, sizeof(veb));
+    veb.elements = n;
+    if (n == 0) return veb;
+
+    while (((uint64_t) 1 << veb.height) - 1 < n) veb.height++;
+    assert(veb.height < 32);
+
+    size_t size = ((size_t) 1 << veb.height) - 1;
+    if (posix_memalign((void**) &veb.keys, 64, sizeof(key_t) * size) != 0) {
+        perror("Failed to allocate van Emde Boas tree.");
+        exit(EXIT_FAILURE);
     }
 
-    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
-    fprintf(fptr, "RB Tree = %0.4lfms\t(%d rotations)\n", total_time/g_average, g_rotation_count/g_average);
+    idx_t pos[32];
+    _veb_levels(&veb, 0, veb.height);
+    _veb_fill(&veb, sorted, pos, 1, 0);
+    return veb;
 }
 
-/* Treap Functions */
-Treap
-tree_treap_create(idx_t initial_capacity) {
-    Treap new_treap;
-    new_treap.nodes = (TreapNode*) malloc(sizeof(TreapNode) * initial_capacity);
-    if (new_treap.nodes == NULL) {
-        perror("Failed to allocate Treap.");
-        exit(EXIT_FAILURE);
+void
+tree_veb_destroy(VebTree *veb) {
+    free(veb->keys);
+    veb->keys = NULL;
+    veb->elements = 0;
+}
+
+/* O fim da árvore repete a maior chave, por isso qualquer posição com a chave serve */
+idx_t
+tree_veb_search(VebTree *veb, key_t key) {
+    const key_t *keys = veb->keys;
+    idx_t pos[32];
+    idx_t i = 1;
+
+    if (veb->elements == 0) return IDX_INVALID;
+
+    pos[0] = 0;
+    for (int depth = 0; ; ) {
+        key_t current = keys[pos[depth]];
+        if (current == key) return pos[depth];
+        if (++depth == veb->height) return IDX_INVALID;
+
+        i = 2*i + (key > current);
+        VebLevel level = veb->level[depth];
+        pos[depth] = pos[level.top_depth] + level.top_size + (i & level.top_size) * level.bottom_size;
     }
+}
 
-    new_treap.tree_root = IDX_INVALID;
-    new_treap.elements = 0;
-    new_treap.capacity = initial_capacity;
+/* Como a árvore é perfeita todas as descidas vão até ao fim em passo certo,
+ * uma chave encontrada só deixa de ser comparada */
+void
+tree_veb_search_batch(VebTree *veb, const key_t *keys, size_t n, idx_t *out_idx) {
+    const key_t *tree_keys = veb->keys;
+    idx_t pos[SEARCH_GROUP][32];
+    idx_t i[SEARCH_GROUP];
 
-    /* inicializar novos nós */
-    TreapNode* endptr = new_treap.nodes + initial_capacity;
-    for (TreapNode *ptr = new_treap.nodes; ptr != endptr; ptr++) {
-        *ptr = (TreapNode){0, 0, IDX_INVALID, IDX_INVALID};
+    if (veb->elements == 0) {
+        for (size_t k = 0; k < n; k++) out_idx[k] = IDX_INVALID;
+        return;
     }
 
-    return new_treap;
+    for (size_t base = 0; base < n; base += SEARCH_GROUP) {
+        int group = (n - base < SEARCH_GROUP) ? (int) (n - base) : SEARCH_GROUP;
+
+        for (int g = 0; g < group; g++) {
+            i[g] = 1;
+            pos[g][0] = 0;
+            out_idx[base + g] = IDX_INVALID;
+        }
+
+        for (int depth = 0; depth < veb->height; depth++) {
+            VebLevel level = veb->level[depth + 1];
+            for (int g = 0; g < group; g++) {
+                key_t key = keys[base + g];
+                key_t current = tree_keys[pos[g][depth]];
+                if (current == key) out_idx[base + g] = pos[g][depth];
+                if (depth + 1 == veb->height) continue;
+
+                i[g] = 2*i[g] + (key > current);
+                pos[g][depth+1] = pos[g][level.top_depth] + level.top_size + (i[g] & level.top_size) * level.bottom_size;
+                __builtin_prefetch(tree_keys + pos[g][depth+1]);
+            }
+        }
+    }
 }
 
-void tree_treap_resize(Treap *treap) {
-    /* se a capacity for máxima */
-    if (treap->capacity == IDX_INVALID - 1) return;
+void
+bulk_test_and_log(key_t* arr, FILE *fptr) {
 
-    idx_t old_capacity = treap->capacity;
-    idx_t new_capacity = (idx_t)(treap->capacity * RESIZE_FACTOR);
+    clock_t start = 0, end = 0;
+    clock_t total_avl = 0, total_rb = 0, total_treap = 0;
+    AVLTree avl;
+    RBTree rb;
+    Treap treap;
 
-    /* se a nova capacity for maior que a capacidade máxima */
-    if (new_capacity < treap->capacity) {
-        new_capacity = IDX_INVALID - 1; 
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        avl = tree_avl_build_sorted(arr, g_treesize);
+        end = clock();
+        perf_stop(&g_perf);
+        total_avl += (end-start);
+        tree_avl_destroy(&avl);
     }
+    fprintf(fptr, "AVL Tree (bulk) = %0.4lfms\t(0 rotations)", ((double) total_avl*1000) / CLOCKS_PER_SEC / g_average);
+    perf_log(fptr, &g_perf, g_average);
 
-    TreapNode *new_nodes = (TreapNode*) realloc(treap->nodes, sizeof(TreapNode) * new_capacity);
-    if (new_nodes == NULL) {
-        perror("Failed to realloc new nodes.");
-        exit(EXIT_FAILURE);
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        rb = tree_rb_build_sorted(arr, g_treesize);
+        end = clock();
+        perf_stop(&g_perf);
+        total_rb += (end-start);
+        tree_rb_destroy(&rb);
     }
-    treap->nodes = new_nodes;
+    fprintf(fptr, "RB Tree (bulk) = %0.4lfms\t(0 rotations)", ((double) total_rb*1000) / CLOCKS_PER_SEC / g_average);
+    perf_log(fptr, &g_perf, g_average);
 
-    /* incializar nova memóra */
-    for (idx_t i = old_capacity; i < new_capacity; i++) {
-        treap->nodes[i] = (TreapNode){0, 0, IDX_INVALID, IDX_INVALID};
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        treap = tree_treap_build_sorted(arr, g_treesize);
+        end = clock();
+        perf_stop(&g_perf);
+        total_treap += (end-start);
+        tree_treap_destroy(&treap);
     }
-
-    treap->capacity = new_capacity;
+    fprintf(fptr, "TREAP (bulk) = %0.4lfms\t(0 rotations)", ((double) total_treap*1000) / CLOCKS_PER_SEC / g_average);
+    perf_log(fptr, &g_perf, g_average);
 }
 
 void
-tree_treap_destroy(Treap *treap) {
-    free(treap->nodes);
-    treap->capacity = 0;
-    treap->elements = 0;
-}
-
+iter_test_and_log(key_t* arr, FILE *fptr) {
 
-static idx_t
-_treap_rotate_right(Treap *treap, idx_t no_idx) {
-    g_rotation_count++;
+    clock_t start = 0, end = 0;
+    clock_t total_avl = 0, total_rb = 0, total_treap = 0;
+    AVLTree avl;
+    RBTree rb;
+    Treap treap;
 
-    TreapNode *nodes = treap->nodes;
-    idx_t pivot_idx = nodes[no_idx].left;
+    g_rotation_count = 0;
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        avl = tree_avl_create(10);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_avl_insert_iter(&avl, arr[idx]);
+        end = clock();
+        perf_stop(&g_perf);
+        total_avl += (end-start);
+        tree_avl_destroy(&avl);
+    }
+    fprintf(fptr, "AVL Tree (iterative) = %0.4lfms\t(%d rotations)", ((double) total_avl*1000) / CLOCKS_PER_SEC / g_average,
+            g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, g_average);
 
-    /* à esquerda agora fica a subtree do pivot */ 
-    nodes[no_idx].left = nodes[pivot_idx].right;
-    /* à direita do pivot fica o nó atual */ 
-    nodes[pivot_idx].right = no_idx;
+    g_rotation_count = 0;
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        rb = tree_rb_create(g_treesize);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_rb_insert_iter(&rb, arr[idx]);
+        end = clock();
+        perf_stop(&g_perf);
+        total_rb += (end-start);
+        tree_rb_destroy(&rb);
+    }
+    fprintf(fptr, "RB Tree (iterative) = %0.4lfms\t(%d rotations)", ((double) total_rb*1000) / CLOCKS_PER_SEC / g_average,
+            g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, g_average);
 
-    /* o pivot não muda de sitio mas pode passar a ser a nova raiz */
-    return pivot_idx;
+    g_rotation_count = 0;
+    perf_clear(&g_perf);
+    for (int i = 0; i < g_average; i++) {
+        perf_start(&g_perf);
+        start = clock();
+        treap = tree_treap_create(g_treesize);
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            tree_treap_insert_iter(&treap, arr[idx]);
+        end = clock();
+        perf_stop(&g_perf);
+        total_treap += (end-start);
+        tree_treap_destroy(&treap);
+    }
+    fprintf(fptr, "TREAP (iterative) = %0.4lfms\t(%d rotations)", ((double) total_treap*1000) / CLOCKS_PER_SEC / g_average,
+            g_rotation_count/g_average);
+    perf_log(fptr, &g_perf, g_average);
 }
 
-static idx_t 
-_treap_rotate_left(Treap *treap, idx_t no_idx) {
-    g_rotation_count++;
+/* Mlookups/s de todas as chaves do conjunto, uma a uma e em lote */
+void
+search_test_and_log(key_t* arr, FILE *fptr) {
 
-    TreapNode *nodes = treap->nodes;
-    idx_t pivot_idx = nodes[no_idx].right;
+    clock_t start = 0, end = 0;
+    clock_t total_single = 0, total_batch = 0;
+    idx_t hits = 0;
+    idx_t *out_idx = malloc(sizeof(idx_t) * g_treesize);
+    double lookups = (double) g_treesize * g_average / 1e6;
 
-    /* subtree do pivot */ 
-    nodes[no_idx].right = nodes[pivot_idx].left;
-    /* o pivot agora leva ao nó */ 
-    nodes[pivot_idx].left = no_idx;
+    AVLTree avl = tree_avl_create(10);
+    tree_avl_insert_arr(&avl, arr, g_treesize);
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_avl_search(&avl, arr[idx]) != NULL);
+        end = clock();
+        total_single += (end-start);
 
-    /* o pivot pode passar a ser a nova raiz */
-    return pivot_idx;
-}
+        start = clock();
+        tree_avl_search_batch(&avl, arr, g_treesize, out_idx);
+        end = clock();
+        total_batch += (end-start);
+    }
+    fprintf(fptr, "AVL search = %0.2lf Mlookups/s\tbatch = %0.2lf Mlookups/s\t(%u hits)\n",
+            lookups / ((double) total_single / CLOCKS_PER_SEC), lookups / ((double) total_batch / CLOCKS_PER_SEC),
+            hits / g_average);
+    tree_avl_destroy(&avl);
+
+    total_single = total_batch = 0;
+    hits = 0;
+    RBTree rb = tree_rb_create(g_treesize);
+    for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+        tree_rb_insert(&rb, arr[idx]);
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_rb_search(&rb, arr[idx]) != -1);
+        end = clock();
+        total_single += (end-start);
 
-static idx_t
-_treap_insert_recursive(Treap *treap, idx_t idx, key_t key) {
-    TreapNode *nodes = treap->nodes;
+        start = clock();
+        tree_rb_search_batch(&rb, arr, g_treesize, out_idx);
+        end = clock();
+        total_batch += (end-start);
+    }
+    fprintf(fptr, "RB search = %0.2lf Mlookups/s\tbatch = %0.2lf Mlookups/s\t(%u hits)\n",
+            lookups / ((double) total_single / CLOCKS_PER_SEC), lookups / ((double) total_batch / CLOCKS_PER_SEC),
+            hits / g_average);
+    tree_rb_destroy(&rb);
+
+    total_single = total_batch = 0;
+    hits = 0;
+    Treap treap = tree_treap_create(g_treesize);
+    for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+        tree_treap_insert(&treap, arr[idx]);
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_treap_search(&treap, arr[idx]) != IDX_INVALID);
+        end = clock();
+        total_single += (end-start);
 
-    /* Criamos um novo nó quando quando o idx é inválido,
-     * ou seja, quando o BST tenta inserir numa folha
-     * depois devolvemos o novo indice à chamada anterior desta função*/
-    if (idx == IDX_INVALID) {
-        idx_t new_index = treap->elements;
-        treap->elements++;
-        nodes[new_index] = (TreapNode){
-            .key = key,
-            .priority = (idx_t)rand_idx(1, IDX_INVALID - 1),
-            .left = IDX_INVALID,
-            .right = IDX_INVALID
-        };
-        return new_index;
+        start = clock();
+        tree_treap_search_batch(&treap, arr, g_treesize, out_idx);
+        end = clock();
+        total_batch += (end-start);
     }
+    fprintf(fptr, "TREAP search = %0.2lf Mlookups/s\tbatch = %0.2lf Mlookups/s\t(%u hits)\n",
+            lookups / ((double) total_single / CLOCKS_PER_SEC), lookups / ((double) total_batch / CLOCKS_PER_SEC),
+            hits / g_average);
+    tree_treap_destroy(&treap);
 
-    /* inserir tipo binary search tree */
-    if (key < nodes[idx].key) {
-        nodes[idx].left = _treap_insert_recursive(treap, nodes[idx].left, key);
+    free(out_idx);
+}
 
-        /* manter max heap */
-        if (nodes[nodes[idx].left].priority > nodes[idx].priority) {
-            idx = _treap_rotate_right(treap, idx);
+/* Latência por pesquisa (ns) da AVL ligada contra as versões congeladas da mesma árvore */
+void
+freeze_test_and_log(key_t* arr, FILE *fptr) {
+
+    clock_t start = 0, end = 0;
+    clock_t total_freeze = 0, total_avl = 0, total_avl_batch = 0;
+    clock_t total_eytz = 0, total_eytz_batch = 0, total_veb = 0, total_veb_batch = 0;
+    idx_t hits = 0;
+    idx_t *out_idx = malloc(sizeof(idx_t) * g_treesize);
+    key_t *sorted = malloc(sizeof(key_t) * g_treesize);
+    double lookups = (double) g_treesize * g_average;
+
+    AVLTree avl = tree_avl_create(10);
+    tree_avl_insert_arr(&avl, arr, g_treesize);
+
+    EytzTree eytz;
+    VebTree veb;
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        idx_t count = tree_avl_sorted_keys(&avl, sorted);
+        eytz = tree_eytz_freeze(sorted, count);
+        veb = tree_veb_freeze(sorted, count);
+        end = clock();
+        total_freeze += (end-start);
+        if (i + 1 < g_average) {
+            tree_eytz_destroy(&eytz);
+            tree_veb_destroy(&veb);
         }
+    }
 
-    } else if (key > nodes[idx].key) {
-        nodes[idx].right = _treap_insert_recursive(treap, nodes[idx].right, key);
+    for (int i = 0; i < g_average; i++) {
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_avl_search(&avl, arr[idx]) != NULL);
+        end = clock();
+        total_avl += (end-start);
 
-        /* manter max heap */
-        if (nodes[nodes[idx].right].priority > nodes[idx].priority) {
-            idx = _treap_rotate_left(treap, idx);
-        }
+        start = clock();
+        tree_avl_search_batch(&avl, arr, g_treesize, out_idx);
+        end = clock();
+        total_avl_batch += (end-start);
 
-    }
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_eytz_search(&eytz, arr[idx]) != IDX_INVALID);
+        end = clock();
+        total_eytz += (end-start);
 
-    return idx;
-}
+        start = clock();
+        tree_eytz_search_batch(&eytz, arr, g_treesize, out_idx);
+        end = clock();
+        total_eytz_batch += (end-start);
 
-/* inserir nó */
-void
-tree_treap_insert(Treap *treap, key_t key) {
-    if (treap->capacity == treap->elements)    
-        tree_treap_resize(treap);
+        start = clock();
+        for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++)
+            hits += (tree_veb_search(&veb, arr[idx]) != IDX_INVALID);
+        end = clock();
+        total_veb += (end-start);
 
-    treap->tree_root = _treap_insert_recursive(treap, treap->tree_root, key);
+        start = clock();
+        tree_veb_search_batch(&veb, arr, g_treesize, out_idx);
+        end = clock();
+        total_veb_batch += (end-start);
+    }
+
+    double ns = 1e9 / CLOCKS_PER_SEC / lookups;
+    fprintf(fptr, "Freeze = %0.4lfms\tAVL = %0.1lfns (batch %0.1lfns)\tEytzinger = %0.1lfns (batch %0.1lfns)"
+            "\tvEB = %0.1lfns (batch %0.1lfns)\t(%u hits)\n",
+            ((double) total_freeze*1000) / CLOCKS_PER_SEC / g_average,
+            total_avl * ns, total_avl_batch * ns, total_eytz * ns, total_eytz_batch * ns,
+            total_veb * ns, total_veb_batch * ns, hits / g_average / 3);
+
+    tree_eytz_destroy(&eytz);
+    tree_veb_destroy(&veb);
+    tree_avl_destroy(&avl);
+    free(sorted);
+    free(out_idx);
 }
 
+/* Janelas de CURSOR_WINDOW chaves consecutivas: um range_count com o cursor
+ * contra uma pesquisa pontual por cada chave da janela. Mkeys/s */
+#define CURSOR_WINDOW 1024
+#define CURSOR_QUERIES 256
 void
-tree_treap_visualize(Treap *treap, idx_t root, int depth, const char *prefix, int is_left) {
-    if (root == IDX_INVALID) return;
+cursor_test_and_log(key_t* arr, FILE *fptr) {
+
+    AVLTree avl = tree_avl_create(10);
+    RBTree rb = tree_rb_create(10);
+    Treap treap = tree_treap_create(10);
+    tree_avl_insert_arr(&avl, arr, g_treesize);
+    for (idx_t idx = 0; idx < (idx_t) g_treesize; idx++) {
+        tree_rb_insert(&rb, arr[idx]);
+        tree_treap_insert(&treap, arr[idx]);
+    }
 
-    TreapNode *node = &treap->nodes[root];
+    key_t *sorted = malloc(sizeof(key_t) * g_treesize);
+    size_t count = tree_avl_sorted_keys(&avl, sorted);
+    size_t window = (count < CURSOR_WINDOW) ? count : CURSOR_WINDOW;
+    if (window == 0) {
+        free(sorted);
+        tree_avl_destroy(&avl);
+        tree_rb_destroy(&rb);
+        tree_treap_destroy(&treap);
+        return;
+    }
 
-    // Print current node
-    printf("%s", prefix);
-    printf("%s", (depth == 0) ? "" : (is_left ? "├── " : "└── "));
-    printf("(%d, p=%u)\n", node->key, node->priority);
+    TreeCursor cursors[3] = {tree_avl_cursor(&avl), tree_rb_cursor(&rb), tree_treap_cursor(&treap)};
+    const char *names[3] = {"AVL", "RB", "TREAP"};
+    clock_t total_scan[3] = {0}, total_point[3] = {0};
+    clock_t start = 0, end = 0;
+    size_t found = 0, scanned = 0;
 
-    // Prepare prefix for child nodes
-    char new_prefix[256];
-    snprintf(new_prefix, sizeof(new_prefix), "%s%s", prefix, (depth == 0) ? "" : (is_left ? "│   " : "    "));
+    for (int i = 0; i < g_average; i++) {
+        for (int t = 0; t < 3; t++) {
+            start = clock();
+            for (size_t q = 0; q < CURSOR_QUERIES; q++) {
+                size_t first = (q * 7919) % (count - window + 1);
+                scanned += tree_cursor_range_count(&cursors[t], sorted[first], sorted[first + window - 1]);
+            }
+            end = clock();
+            total_scan[t] += (end-start);
+
+            start = clock();
+            for (size_t q = 0; q < CURSOR_QUERIES; q++) {
+                size_t first = (q * 7919) % (count - window + 1);
+                for (size_t k = first; k < first + window; k++) {
+                    if (t == 0) found += (tree_avl_search(&avl, sorted[k]) != NULL);
+                    else if (t == 1) found += (tree_rb_search(&rb, sorted[k]) != -1);
+                    else found += (tree_treap_search(&treap, sorted[k]) != IDX_INVALID);
+                }
+            }
+            end = clock();
+            total_point[t] += (end-start);
+        }
+    }
 
-    // Right child (printed first for better tree shape)
-    tree_treap_visualize(treap, node->right, depth + 1, new_prefix, 1);
+    double keys = (double) window * CURSOR_QUERIES * g_average;
+    for (int t = 0; t < 3; t++) {
+        fprintf(fptr, "%s range scan = %0.1lfMkeys/s\tpoint searches = %0.1lfMkeys/s\t",
+                names[t],
+                keys / ((double) (total_scan[t] ? total_scan[t] : 1) / CLOCKS_PER_SEC) / 1e6,
+                keys / ((double) (total_point[t] ? total_point[t] : 1) / CLOCKS_PER_SEC) / 1e6);
+    }
+    fprintf(fptr, "(%zu keys per range, %s)\n", window, (scanned == found) ? "counts match" : "COUNT MISMATCH");
 
-    // Left child
-    tree_treap_visualize(treap, node->left, depth + 1, new_prefix, 0);
+    free(sorted);
+    tree_avl_destroy(&avl);
+    tree_rb_destroy(&rb);
+    tree_treap_destroy(&treap);
 }
 
+/* Metade das chaves entra primeiro, depois cada passo apaga a mais antiga e
+ * insere a seguinte, com o tamanho fixo em g_treesize/2. No fim conta quantos
+ * slots o arena tem e quanto custa o compact */
 void
-treap_test_and_log(key_t* arr, FILE *fptr) {
+delete_test_and_log(key_t* arr, FILE *fptr) {
 
-    Treap treap;
     clock_t start = 0, end = 0;
-    clock_t total = 0;
+    clock_t total_mixed = 0, total_compact = 0;
+    idx_t window = g_treesize / 2;
+    idx_t ops = g_treesize - window;
+    idx_t slots = 0, capacity = 0, compacted = 0;
 
-    /* Reset global rotation counter */
-    g_rotation_count = 0;
+    for (int i = 0; i < g_average; i++) {
+        BinTree btree = tree_binary_create(10);
+        tree_binary_insert_arr(&btree, arr, window);
+        start = clock();
+        for (idx_t idx = window; idx < (idx_t) g_treesize; idx++) {
+            tree_binary_delete(&btree, arr[idx - window]);
+            tree_binary_insert(&btree, arr[idx]);
+        }
+        end = clock();
+        total_mixed += (end-start);
+        slots = btree.elements;
+        capacity = btree.capacity;
+
+        start = clock();
+        tree_binary_compact(&btree);
+        end = clock();
+        total_compact += (end-start);
+        compacted = btree.capacity;
+        tree_binary_destroy(btree);
+    }
+    fprintf(fptr, "Binary Tree mixed = %0.4lfms\t(%u ops, %u slots, capacity %u)\tcompact = %0.4lfms\t(capacity %u)\n",
+            ((double) total_mixed*1000) / CLOCKS_PER_SEC / g_average, 2*ops, slots, capacity,
+            ((double) total_compact*1000) / CLOCKS_PER_SEC / g_average, compacted);
 
+    total_mixed = total_compact = 0;
+    for (int i = 0; i < g_average; i++) {
+        AVLTree avl = tree_avl_create(10);
+        tree_avl_insert_arr(&avl, arr, window);
+        start = clock();
+        for (idx_t idx = window; idx < (idx_t) g_treesize; idx++) {
+            tree_avl_delete(&avl, arr[idx - window]);
+            tree_avl_insert(&avl, arr[idx]);
+        }
+        end = clock();
+        total_mixed += (end-start);
+        slots = avl.elements;
+        capacity = avl.capacity;
 
-    for (int i = 0; i < 1; i++) {
         start = clock();
-        treap = tree_treap_create(g_treesize);
-        for (idx_t idx = 0; idx < g_treesize; idx++)
+        tree_avl_compact(&avl);
+        end = clock();
+        total_compact += (end-start);
+        compacted = avl.capacity;
+        tree_avl_destroy(&avl);
+    }
+    fprintf(fptr, "AVL Tree mixed = %0.4lfms\t(%u ops, %u slots, capacity %u)\tcompact = %0.4lfms\t(capacity %u)\n",
+            ((double) total_mixed*1000) / CLOCKS_PER_SEC / g_average, 2*ops, slots, capacity,
+            ((double) total_compact*1000) / CLOCKS_PER_SEC / g_average, compacted);
+
+    total_mixed = total_compact = 0;
+    for (int i = 0; i < g_average; i++) {
+        RBTree rb = tree_rb_create(10);
+        for (idx_t idx = 0; idx < window; idx++)
+            tree_rb_insert(&rb, arr[idx]);
+        start = clock();
+        for (idx_t idx = window; idx < (idx_t) g_treesize; idx++) {
+            tree_rb_delete(&rb, arr[idx - window]);
+            tree_rb_insert(&rb, arr[idx]);
+        }
+        end = clock();
+        total_mixed += (end-start);
+        slots = rb.elements;
+        capacity = rb.capacity;
+
+        start = clock();
+        tree_rb_compact(&rb);
+        end = clock();
+        total_compact += (end-start);
+        compacted = rb.capacity;
+        tree_rb_destroy(&rb);
+    }
+    fprintf(fptr, "RB Tree mixed = %0.4lfms\t(%u ops, %u slots, capacity %u)\tcompact = %0.4lfms\t(capacity %u)\n",
+            ((double) total_mixed*1000) / CLOCKS_PER_SEC / g_average, 2*ops, slots, capacity,
+            ((double) total_compact*1000) / CLOCKS_PER_SEC / g_average, compacted);
+
+    total_mixed = total_compact = 0;
+    for (int i = 0; i < g_average; i++) {
+        Treap treap = tree_treap_create(10);
+        for (idx_t idx = 0; idx < window; idx++)
+            tree_treap_insert(&treap, arr[idx]);
+        start = clock();
+        for (idx_t idx = window; idx < (idx_t) g_treesize; idx++) {
+            tree_treap_delete(&treap, arr[idx - window]);
             tree_treap_insert(&treap, arr[idx]);
+        }
         end = clock();
+        total_mixed += (end-start);
+        slots = treap.elements;
+        capacity = treap.capacity;
 
-        total += (end-start);
+        start = clock();
+        tree_treap_compact(&treap);
+        end = clock();
+        total_compact += (end-start);
+        compacted = treap.capacity;
         tree_treap_destroy(&treap);
     }
-
-    double total_time = ((double) total*1000) / CLOCKS_PER_SEC;
-    fprintf(fptr, "TREAP = %0.4lfms\t(%d rotations)\n", total_time/g_average, g_rotation_count/g_average);
+    fprintf(fptr, "TREAP mixed = %0.4lfms\t(%u ops, %u slots, capacity %u)\tcompact = %0.4lfms\t(capacity %u)\n",
+            ((double) total_mixed*1000) / CLOCKS_PER_SEC / g_average, 2*ops, slots, capacity,
+            ((double) total_compact*1000) / CLOCKS_PER_SEC / g_average, compacted);
 }
 
 void tree_treap_inorder_print(Treap *treap, idx_t root) {
@@ -1165,6 +6046,8 @@ main(int argc, char *argv[]) {
     key_t *conjunto_c = arr_gen_conj_c(g_treesize);
     key_t *conjunto_d = arr_gen_conj_d(g_treesize);
 
+    perf_open(&g_perf);
+
     FILE* filelog = fopen("log.txt", "a");
     fprintf(filelog, "\n=== NEW LOG === (Treesize = %d, Average = &d)\n", g_treesize, g_average);
 
@@ -1174,30 +6057,113 @@ main(int argc, char *argv[]) {
     binary_test_and_log(conjunto_c, filelog);
     binary_test_and_log(conjunto_d, filelog);
 
-    /*puts("Testing AVL tree...");*/
-    /*avl_test_and_log(conjunto_a, filelog);*/
-    /*avl_test_and_log(conjunto_b, filelog);*/
-    /*avl_test_and_log(conjunto_c, filelog);*/
-    /*avl_test_and_log(conjunto_d, filelog);*/
-    /**/
-    /*puts("Testing Red-Black tree...");*/
-    /*rb_test_and_log(conjunto_a, filelog);*/
-    /*rb_test_and_log(conjunto_b, filelog);*/
-    /*rb_test_and_log(conjunto_c, filelog);*/
-    /*rb_test_and_log(conjunto_d, filelog);*/
-    /**/
-    /*puts("Testing RB search tree...");*/
-    /*treap_test_and_log(conjunto_a, filelog);*/
-    /*treap_test_and_log(conjunto_b, filelog);*/
-    /*treap_test_and_log(conjunto_c, filelog);*/
-    /*treap_test_and_log(conjunto_d, filelog);*/
-    /**/
+    puts("Testing binary tree key scan (AoS vs SoA)...");
+    soa_test_and_log(conjunto_a, filelog);
+    soa_test_and_log(conjunto_b, filelog);
+    soa_test_and_log(conjunto_c, filelog);
+    soa_test_and_log(conjunto_d, filelog);
+
+    puts("Testing implicit binary tree (keys only)...");
+    implicit_test_and_log(conjunto_a, filelog);
+    implicit_test_and_log(conjunto_b, filelog);
+    implicit_test_and_log(conjunto_c, filelog);
+    implicit_test_and_log(conjunto_d, filelog);
+
+    puts("Testing AVL tree...");
+    avl_test_and_log(conjunto_a, filelog);
+    avl_test_and_log(conjunto_b, filelog);
+    avl_test_and_log(conjunto_c, filelog);
+    avl_test_and_log(conjunto_d, filelog);
+
+    puts("Testing B+ tree...");
+    btree_test_and_log(conjunto_a, filelog);
+    btree_test_and_log(conjunto_b, filelog);
+    btree_test_and_log(conjunto_c, filelog);
+    btree_test_and_log(conjunto_d, filelog);
+
+    puts("Testing Red-Black tree...");
+    rb_test_and_log(conjunto_a, filelog);
+    rb_test_and_log(conjunto_b, filelog);
+    rb_test_and_log(conjunto_c, filelog);
+    rb_test_and_log(conjunto_d, filelog);
+
+    puts("Testing packed AVL and Red-Black layouts...");
+    packed_test_and_log(conjunto_a, filelog);
+    packed_test_and_log(conjunto_b, filelog);
+    packed_test_and_log(conjunto_c, filelog);
+    packed_test_and_log(conjunto_d, filelog);
+
+    puts("Testing Treap...");
+    treap_test_and_log(conjunto_a, filelog);
+    treap_test_and_log(conjunto_b, filelog);
+    treap_test_and_log(conjunto_c, filelog);
+    treap_test_and_log(conjunto_d, filelog);
+
+    puts("Testing bulk load (AVL, Red-Black, Treap)...");
+    bulk_test_and_log(conjunto_a, filelog);
+    bulk_test_and_log(conjunto_b, filelog);
+    bulk_test_and_log(conjunto_c, filelog);
+    bulk_test_and_log(conjunto_d, filelog);
+
+    puts("Testing iterative insertion (AVL, Red-Black, Treap)...");
+    iter_test_and_log(conjunto_a, filelog);
+    iter_test_and_log(conjunto_b, filelog);
+    iter_test_and_log(conjunto_c, filelog);
+    iter_test_and_log(conjunto_d, filelog);
+
+    puts("Testing batched search (AVL, Red-Black, Treap)...");
+    search_test_and_log(conjunto_c, filelog);
+    search_test_and_log(conjunto_d, filelog);
+
+    puts("Testing frozen Eytzinger and van Emde Boas layouts...");
+    freeze_test_and_log(conjunto_c, filelog);
+    freeze_test_and_log(conjunto_d, filelog);
+
+    puts("Testing mixed insert/delete workload...");
+    delete_test_and_log(conjunto_a, filelog);
+    delete_test_and_log(conjunto_b, filelog);
+    delete_test_and_log(conjunto_c, filelog);
+    delete_test_and_log(conjunto_d, filelog);
+
+    puts("Testing ordered cursors and range scans...");
+    cursor_test_and_log(conjunto_a, filelog);
+    cursor_test_and_log(conjunto_b, filelog);
+    cursor_test_and_log(conjunto_c, filelog);
+    cursor_test_and_log(conjunto_d, filelog);
+
+    puts("Testing snapshot readers with a concurrent writer...");
+    snap_test_and_log(conjunto_a, filelog);
+    snap_test_and_log(conjunto_b, filelog);
+    snap_test_and_log(conjunto_c, filelog);
+    snap_test_and_log(conjunto_d, filelog);
+
+    puts("Testing lock-free skip list...");
+    skiplist_test_and_log(conjunto_a, filelog);
+    skiplist_test_and_log(conjunto_b, filelog);
+    skiplist_test_and_log(conjunto_c, filelog);
+    skiplist_test_and_log(conjunto_d, filelog);
+
+    puts("Testing treap set operations...");
+    treap_set_test_and_log(conjunto_a, filelog);
+    treap_set_test_and_log(conjunto_b, filelog);
+    treap_set_test_and_log(conjunto_c, filelog);
+    treap_set_test_and_log(conjunto_d, filelog);
+
+#ifdef TREE_ORDER_STATS
+    puts("Testing rank and select...");
+    order_test_and_log(conjunto_a, filelog);
+    order_test_and_log(conjunto_b, filelog);
+    order_test_and_log(conjunto_c, filelog);
+    order_test_and_log(conjunto_d, filelog);
+#endif
+
     free(conjunto_a);
     free(conjunto_b);
     free(conjunto_c);
     free(conjunto_d);
 
     fclose(filelog);
+    perf_close(&g_perf);
 
     puts("Done!");
     system("notify-send -u critical done");